@@ -0,0 +1,189 @@
+import os
+import sys
+
+# Turns data/buttons_simple.conf into constant tables of the built-in
+# fallback config (src/builtinConfigData.h, see src/builtinConfig.h),
+# along with its source text, served by /api/config.
+# Runs before every build as a PlatformIO pre-script, the header is
+# only rewritten if it changed. Can also be run by hand:
+#
+# usage: python3 gen_builtin_config.py [config] [header]
+
+SOURCE = "data/buttons_simple.conf"
+OUTPUT = "src/builtinConfigData.h"
+
+try:
+    Import("env")
+    PROJECT_DIR = env.subst("$PROJECT_DIR")
+except NameError:
+    env = None
+    PROJECT_DIR = os.path.dirname(os.path.abspath(__file__))
+
+try:
+    import tomllib
+except ImportError:
+    try:
+        import tomli as tomllib
+    except ImportError:
+        if env is None:
+            sys.exit("gen_builtin_config.py needs python 3.11+, or 'pip install tomli'")
+        env.Execute("$PYTHONEXE -m pip install tomli")
+        import tomli as tomllib
+
+# in the order pin_t checks them
+IO_TYPES = [
+    ("SINK", "MOSFET"),
+    ("RL", "RELAY"),
+    ("OC", "OPTO"),
+    ("TTL", "TTL"),
+    ("INP", "INP"),
+]
+
+FILTERS = {
+    "debounce": "FILTER_DEBOUNCE",
+    "integrator": "FILTER_INTEGRATOR",
+}
+
+
+def fail(msg):
+    sys.exit("{}: {}".format(source, msg))
+
+
+def cString(text):
+    out = '"'
+    for b in text.encode("utf-8"):
+        c = chr(b)
+        if c in '"\\':
+            out += "\\" + c
+        elif c == "\n":
+            out += "\\n"
+        elif 0x20 <= b < 0x7f:
+            out += c
+        else:
+            out += "\\{:03o}".format(b)
+    return out + '"'
+
+
+# one literal per line, so the generated header stays readable
+def cText(text):
+    lines = text.splitlines(keepends=True)
+    if len(lines) == 0:
+        return '""'
+    return "\n".join("    " + cString(line) for line in lines)
+
+
+# same as pin_t(name, antctrl, sch)
+def parsePin(p):
+    antctrl = p["antctrl"]
+    ioType = None
+    for prefix, name in IO_TYPES:
+        if prefix in antctrl:
+            ioType = name
+            break
+    if ioType is None:
+        fail("could not parse pin type from: " + antctrl)
+    digits = "".join(c for c in antctrl if c.isdigit())
+    if digits == "":
+        fail("could not parse pin number from: " + antctrl)
+
+    pin = {
+        "name": p["name"],
+        "sch": p["sch"],
+        "ioType": ioType,
+        "ioNum": int(digits) - 1,
+        "filter": "FILTER_DEBOUNCE",
+        "assertMs": 0,
+        "deassertMs": 0,
+    }
+    if ioType == "INP":
+        debounce = p.get("debounce", 0)
+        pin["assertMs"] = p.get("debounce_assert", debounce)
+        pin["deassertMs"] = p.get("debounce_deassert", debounce)
+        mode = p.get("filter", "debounce")
+        if mode not in FILTERS:
+            fail("unknown filter '{}' for pin {}".format(mode, pin["name"]))
+        pin["filter"] = FILTERS[mode]
+    return pin
+
+
+def generate(config, text):
+    pins = [parsePin(p) for p in config.get("pin", [])]
+
+    # by name or schematic name, the lowest id wins
+    def pinId(name):
+        for i, p in enumerate(pins):
+            if name in (p["name"], p["sch"]):
+                return i
+        fail("pin '{}' not found!".format(name))
+
+    groups = sorted(config.get("buttons", {}).keys())
+    buttons = []
+    buttonPins = []
+    guards = []
+    for groupId, group in enumerate(groups):
+        for b in config["buttons"][group]:
+            buttonId = len(buttons)
+            ids = []
+            for p in b["pins"]:
+                if pinId(p) not in ids:
+                    ids.append(pinId(p))
+            buttons.append((b["name"], groupId, len(buttonPins), len(ids)))
+            buttonPins += ids
+            for key, onHigh in (("disable_on_low", "false"), ("disable_on_high", "true")):
+                for p in b.get(key, []):
+                    guards.append((pinId(p), buttonId, onHigh))
+
+    def table(type, name, rows):
+        # zero-length arrays are not allowed, counts are kept separately
+        if len(rows) == 0:
+            rows = ["{}"]
+        return "constexpr {} {}[] = {{\n{}\n}};\n".format(
+            type, name, "\n".join("    " + r + "," for r in rows))
+
+    out = "// Generated by gen_builtin_config.py from {} - do not edit.\n".format(SOURCE)
+    out += "// Included by builtinConfig.h only.\n\n"
+    out += "namespace builtin {\n\n"
+    out += "constexpr int PIN_COUNT = {};\n".format(len(pins))
+    out += "constexpr int GROUP_COUNT = {};\n".format(len(groups))
+    out += "constexpr int BUTTON_COUNT = {};\n".format(len(buttons))
+    out += "constexpr int BUTTON_PIN_COUNT = {};\n".format(len(buttonPins))
+    out += "constexpr int GUARD_COUNT = {};\n\n".format(len(guards))
+    out += table("builtinPin_t", "PINS", [
+        "{{{}, {}, {}, {}, {}, {}, {}}}".format(cString(p["name"]), cString(p["sch"]),
+            p["ioType"], p["ioNum"], p["filter"], p["assertMs"], p["deassertMs"])
+        for p in pins]) + "\n"
+    out += table("const char*", "GROUPS", [cString(g) for g in groups]) + "\n"
+    out += table("builtinButton_t", "BUTTONS", [
+        "{{{}, {}, {}, {}}}".format(cString(name), groupId, first, count)
+        for name, groupId, first, count in buttons]) + "\n"
+    out += table("uint16_t", "BUTTON_PINS", [str(i) for i in buttonPins]) + "\n"
+    out += table("builtinGuard_t", "GUARDS", [
+        "{{{}, {}, {}}}".format(pin, button, onHigh)
+        for pin, button, onHigh in guards]) + "\n"
+    out += "constexpr char SOURCE[] =\n{};\n\n".format(cText(text))
+    out += "} // namespace builtin\n"
+    return out
+
+
+def main(output):
+    with open(source, encoding="utf-8") as f:
+        text = f.read()
+    try:
+        config = tomllib.loads(text)
+    except tomllib.TOMLDecodeError as e:
+        fail(str(e))
+    header = generate(config, text)
+
+    if os.path.exists(output):
+        with open(output) as f:
+            if f.read() == header:
+                return
+    with open(output, "w") as f:
+        f.write(header)
+    print("gen_builtin_config.py: {} updated".format(output))
+
+
+if env is not None or __name__ == "__main__":
+    args = sys.argv[1:] if env is None else []
+    source = args[0] if len(args) > 0 else os.path.join(PROJECT_DIR, SOURCE)
+    main(args[1] if len(args) > 1 else os.path.join(PROJECT_DIR, OUTPUT))
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <iterator>
+#include <vector>
+
 const int PIN_I2C_SCL = 4;
 const int PIN_I2C_SDA = 5;
 const int PIN_I2C_RST = 12;
@@ -23,7 +26,8 @@ const uint8_t PIN_INPUT_12 = 27;
 
 const uint8_t PIN_IN_BUFF_ENA = 13;
 
-const std::vector<uint8_t> input_pins = {
+// INP word bit order
+constexpr uint8_t input_pin_table[] = {
   PIN_INPUT_1,
   PIN_INPUT_2,
   PIN_INPUT_3,
@@ -38,6 +42,9 @@ const std::vector<uint8_t> input_pins = {
   PIN_INPUT_12
 };
 
+const std::vector<uint8_t> input_pins(
+  std::begin(input_pin_table), std::end(input_pin_table));
+
 // user interface
 const int PIN_BOOT_BUT1 = 0;
 const int PIN_BUT2 = 35;
@@ -0,0 +1,58 @@
+#include "allocTracker.h"
+
+#ifdef ALLOC_TRACKING
+
+#include <new>
+#include <stdlib.h>
+
+#include <Arduino.h>
+
+static volatile TaskHandle_t trackedTask = NULL;
+static volatile uint32_t trackedAllocs = 0;
+
+void allocTrackingBegin(){
+    trackedAllocs = 0;
+    trackedTask = xTaskGetCurrentTaskHandle();
+}
+
+uint32_t allocTrackingEnd(){
+    trackedTask = NULL;
+    return trackedAllocs;
+}
+
+static void* trackedAlloc(size_t size){
+    if ((trackedTask != NULL) && (xTaskGetCurrentTaskHandle() == trackedTask)){
+        trackedAllocs++;
+    }
+    void* p = malloc(size);
+    if (p == NULL){
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(size_t size){
+    return trackedAlloc(size);
+}
+
+void* operator new[](size_t size){
+    return trackedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t size) noexcept {
+    free(p);
+}
+
+#endif // ALLOC_TRACKING
@@ -0,0 +1,49 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <stdint.h>
+
+// Heap allocation accounting, enabled with -DALLOC_TRACKING
+// (see [env:antcontroller-alloc]). Global operator new is replaced,
+// and allocations made by the task that opened an AllocScope are
+// counted, so hot paths can be asserted not to allocate.
+// Without the flag, scopes always report 0 allocations.
+
+#ifdef ALLOC_TRACKING
+
+void allocTrackingBegin();
+uint32_t allocTrackingEnd();
+
+class AllocScope {
+public:
+    AllocScope(){
+        allocTrackingBegin();
+    }
+    ~AllocScope(){
+        end();
+    }
+    uint32_t end(){
+        if (!ended){
+            allocs = allocTrackingEnd();
+            ended = true;
+        }
+        return allocs;
+    }
+
+private:
+    bool ended = false;
+    uint32_t allocs = 0;
+};
+
+#else
+
+class AllocScope {
+public:
+    uint32_t end(){
+        return 0;
+    }
+};
+
+#endif // ALLOC_TRACKING
+
+#endif // ALLOC_TRACKER_H
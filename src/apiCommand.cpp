@@ -0,0 +1,221 @@
+#include "apiCommand.h"
+
+#include <charconv>
+
+#include "boardDesc.h"
+#include "configHandler.h"
+#include "traceSpan.h"
+
+static bool fail(apiCommand_t& cmd, const char* error){
+    cmd.target = API_TARGET_NONE;
+    cmd.error = error;
+    return false;
+}
+
+// decimal, or hex with "0x" prefix - the whole token must be a number
+static bool parseNumber(std::string_view str, int* value){
+    int base = 10;
+    if ((str.length() > 2) && (str[0] == '0') && (str[1] == 'x')){
+        str.remove_prefix(2);
+        base = 16;
+    }
+    if (str.empty()){
+        return false;
+    }
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.length(), *value, base);
+    return (ec == std::errc()) && (ptr == str.data() + str.length());
+}
+
+// splits on '/' just like the old splitString() - "" is a single empty
+// arg, and "MOS/bits/" has an empty third one
+static void tokenize(std::string_view path, apiCommand_t& cmd){
+    size_t start = 0;
+    while (cmd.argc < API_MAX_ARGS){
+        size_t end = path.find('/', start);
+        if (end == std::string_view::npos){
+            cmd.args[cmd.argc++] = path.substr(start);
+            return;
+        }
+        cmd.args[cmd.argc++] = path.substr(start, end - start);
+        start = end + 1;
+    }
+}
+
+static bool parseButton(apiCommand_t& cmd){
+    if (cmd.argc < 3){
+        return fail(cmd, "ERR: expected BUT/<group>/<button>");
+    }
+    // parsed on the controller task, same config the command runs with
+    const Config_& cfg = ConfigStore.active();
+    int groupId = cfg.findGroup(cmd.args[1]);
+    if (groupId < 0){
+        return fail(cmd, "ERR: button group not found");
+    }
+    int buttonId = BUTTON_NONE;
+    if (cmd.args[2] != "OFF"){
+        buttonId = cfg.findButton(groupId, cmd.args[2]);
+        if (buttonId < 0){
+            return fail(cmd, "ERR: button not found");
+        }
+    }
+    cmd.target = API_TARGET_BUT;
+    cmd.selector = API_SEL_GROUP;
+    cmd.op = API_OP_WRITE;
+    cmd.index = groupId;
+    cmd.value = buttonId;
+    return true;
+}
+
+static bool parseOutput(apiCommand_t& cmd, std::string_view parameter, std::string_view value){
+    const outputGroupDesc_t& desc = board::OUTPUTS[cmd.ioType];
+
+    int number;
+    if (parseNumber(parameter, &number)){
+        // API pin numbers start from 1
+        if ((number < 1) || (number > desc.width)){
+            return fail(cmd, "ERR: invalid parameter");
+        }
+        cmd.selector = API_SEL_PIN;
+        cmd.index = number - 1;
+        if (value.empty()){
+            cmd.op = API_OP_READ;
+        } else if ((value == "on") || (value == "off")){
+            cmd.op = API_OP_WRITE;
+            cmd.value = (value == "on");
+        } else {
+            return fail(cmd, "ERR: invalid value");
+        }
+    } else if (parameter == "bits"){
+        cmd.selector = API_SEL_BITS;
+        if (value.empty()){
+            cmd.op = API_OP_READ;
+        } else if (parseNumber(value, &number) && (number >= 0) && !(number & ~desc.bitMask)){
+            cmd.op = API_OP_WRITE;
+            cmd.value = number;
+        } else {
+            return fail(cmd, "ERR: invalid bits");
+        }
+    } else {
+        return fail(cmd, "ERR: invalid parameter");
+    }
+    return true;
+}
+
+static bool parseInput(apiCommand_t& cmd, std::string_view parameter, std::string_view value){
+    cmd.op = API_OP_READ;
+    if (parameter == "bits"){
+        cmd.selector = API_SEL_BITS;
+    } else if (parameter == "raw"){
+        cmd.selector = API_SEL_RAW;
+    } else if (parameter == "capture"){
+        cmd.selector = API_SEL_CAPTURE;
+        if (value == "reset"){
+            cmd.op = API_OP_RESET;
+        }
+    } else {
+        return fail(cmd, "ERR: invalid parameter");
+    }
+    return true;
+}
+
+// "STATS", "STATS/reset" or "STATS/<span>"
+static bool parseStats(apiCommand_t& cmd){
+    cmd.target = API_TARGET_STATS;
+    cmd.op = API_OP_READ;
+    cmd.index = SPAN_COUNT;
+    if (cmd.argc < 2){
+        return true;
+    }
+    if (cmd.args[1] == "reset"){
+        cmd.op = API_OP_RESET;
+        return true;
+    }
+    cmd.index = TraceSpans_::spanFromName(cmd.args[1]);
+    if (cmd.index == SPAN_COUNT){
+        return fail(cmd, "ERR: unknown span");
+    }
+    return true;
+}
+
+bool parseApiCommand(std::string_view path, apiCommand_t& cmd){
+    cmd = {};
+    tokenize(path, cmd);
+
+    std::string_view tag = cmd.args[0];
+    if (tag == "INF"){
+        cmd.target = API_TARGET_INF;
+        return true;
+    }
+    if (tag == "RST"){
+        cmd.target = API_TARGET_RST;
+        return true;
+    }
+    if (tag == "SYN"){
+        cmd.target = API_TARGET_SYN;
+        bool verifyOnly = (cmd.argc > 1) && (cmd.args[1] == "verify");
+        cmd.op = verifyOnly ? API_OP_READ : API_OP_WRITE;
+        return true;
+    }
+    if (tag == "BUS"){
+        cmd.target = API_TARGET_BUS;
+        bool reset = (cmd.argc > 1) && (cmd.args[1] == "reset");
+        cmd.op = reset ? API_OP_RESET : API_OP_READ;
+        return true;
+    }
+    if (tag == "SAF"){
+        cmd.target = API_TARGET_SAF;
+        bool reset = (cmd.argc > 1) && (cmd.args[1] == "reset");
+        cmd.op = reset ? API_OP_RESET : API_OP_READ;
+        return true;
+    }
+    if (tag == "STATS"){
+        return parseStats(cmd);
+    }
+    if (tag == "BUT"){
+        return parseButton(cmd);
+    }
+
+    cmd.ioType = ioTypeFromTag(tag);
+    if (cmd.ioType == OUT_TYPE_COUNT){
+        return fail(cmd, "ERR: API call for tag not found");
+    }
+    cmd.target = API_TARGET_IO;
+
+    switch (cmd.argc){
+    case 1:
+        return fail(cmd, "ERR: no parameter");
+    case 2:
+    case 3:
+        break;
+    default:
+        return fail(cmd, "ERR: too many parameters");
+    }
+    std::string_view parameter = cmd.args[1];
+    std::string_view value = (cmd.argc > 2) ? cmd.args[2] : std::string_view();
+
+    if (cmd.ioType == INP){
+        return parseInput(cmd, parameter, value);
+    }
+    return parseOutput(cmd, parameter, value);
+}
+
+int parseApiBatch(std::string_view body, apiCommand_t* cmds, int maxCommands){
+    int count = 0;
+    while (!body.empty()){
+        size_t end = body.find_first_of(";\n");
+        std::string_view line = body.substr(0, end);
+        body = (end == std::string_view::npos) ? std::string_view() : body.substr(end + 1);
+
+        if (!line.empty() && (line.back() == '\r')){
+            line.remove_suffix(1);
+        }
+        if (line.empty()){
+            continue;
+        }
+        if (count == maxCommands){
+            return -1;
+        }
+        parseApiCommand(line, cmds[count++]);
+    }
+    return count;
+}
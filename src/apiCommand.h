@@ -0,0 +1,63 @@
+#ifndef API_COMMAND_H
+#define API_COMMAND_H
+
+#include <stdint.h>
+#include <string_view>
+
+#include "ioControllerTypes.h"
+
+// Typed API call, parsed once from a "<CMD>/<INDEX>/<VALUE>" path by
+// parseApiCommand(), then executed by IoController::handleApiCall().
+// Every transport (HTTP, serial, batch) goes through the same parser.
+// Parsing does not allocate - names are resolved into IDs, and args
+// are views into the parsed string.
+
+const int API_MAX_ARGS = 4;
+
+typedef enum : uint8_t {
+    API_TARGET_NONE = 0,    // parsing failed, see error
+    API_TARGET_INF,
+    API_TARGET_RST,
+    API_TARGET_SYN,
+    API_TARGET_BUS,
+    API_TARGET_SAF,
+    API_TARGET_STATS,       // index - span_t, SPAN_COUNT for all the spans
+    API_TARGET_BUT,
+    API_TARGET_IO           // ioType
+} apiTarget_t;
+
+typedef enum : uint8_t {
+    API_SEL_NONE = 0,
+    API_SEL_PIN,            // index - pin number, from 0
+    API_SEL_BITS,
+    API_SEL_RAW,            // INP only
+    API_SEL_CAPTURE,        // INP only
+    API_SEL_GROUP           // BUT, index - group id
+} apiSelector_t;
+
+typedef enum : uint8_t {
+    API_OP_READ = 0,
+    API_OP_WRITE,           // value - pin level, bits, or button id (BUTTON_NONE for OFF)
+    API_OP_RESET            // BUS/reset, SAF/reset, STATS/reset, INP/capture/reset
+} apiOp_t;
+
+typedef struct {
+    apiTarget_t target;
+    antControllerIoType_t ioType;
+    apiSelector_t selector;
+    apiOp_t op;
+    int index;
+    int value;
+    const char* error;      // NULL if parsed ok
+
+    uint8_t argc;
+    std::string_view args[API_MAX_ARGS];
+} apiCommand_t;
+
+bool parseApiCommand(std::string_view path, apiCommand_t& cmd);
+
+// commands separated by newlines or ';', returns the number of
+// commands, or -1 if there's more than maxCommands
+int parseApiBatch(std::string_view body, apiCommand_t* cmds, int maxCommands);
+
+#endif // API_COMMAND_H
@@ -0,0 +1,74 @@
+#ifndef BINARY_FRAME_H
+#define BINARY_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ioControllerTypes.h"
+#include "boardDesc.h"
+
+// Fixed-layout frames of the /api/BIN endpoint (and "BIN" serial
+// command). All fields are little-endian, structs are packed.
+//
+// request:  empty (read only), or binWriteHeader_t + opCount * binWriteOp_t
+// response: binStateFrame_t, always - after the write was applied
+
+const uint8_t BIN_PROTO_VERSION = 1;
+const uint8_t BIN_MAGIC_STATE = 'S';
+const uint8_t BIN_MAGIC_WRITE = 'W';
+const int BIN_MAX_WRITE_OPS = 16;
+
+typedef enum : uint8_t {
+    BIN_OP_SET = 0,     // bits in mask are set
+    BIN_OP_CLEAR,       // bits in mask are cleared
+    BIN_OP_TOGGLE       // bits in mask are inverted
+} binOp_t;
+
+typedef enum : uint8_t {
+    BIN_OK = 0,
+    BIN_ERR_FRAME,      // bad length or magic
+    BIN_ERR_VERSION,
+    BIN_ERR_ARG,        // not an output, unknown op, or mask out of range
+    BIN_ERR_LOCKED,     // controller locked, in panic or busy - nothing written
+    BIN_ERR_BUS         // expander write failed, see /api/SYN
+} binStatus_t;
+
+const uint8_t BIN_FLAG_LOCKED = 0x01;
+const uint8_t BIN_FLAG_PANIC = 0x02;
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;      // BIN_MAGIC_WRITE
+    uint8_t version;
+    uint8_t opCount;
+} binWriteHeader_t;
+
+// ops are applied in order, on top of each other - all of them are
+// committed together, or none if any is invalid
+typedef struct __attribute__((packed)) {
+    uint8_t ioType;     // antControllerIoType_t, outputs only
+    uint8_t op;         // binOp_t
+    uint16_t mask;      // group bits, as in /api/<TAG>/bits
+} binWriteOp_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t magic;      // BIN_MAGIC_STATE
+    uint8_t version;
+    uint8_t status;     // binStatus_t of the request
+    uint8_t flags;      // BIN_FLAG_*
+    uint32_t seq;       // state sequence number, as in state events
+    uint32_t generation;
+    uint16_t outputs[OUTPUT_GROUP_COUNT]; // indexed by antControllerIoType_t
+    uint16_t inputs;
+    uint8_t groupCount;
+    uint8_t reserved;
+    int16_t activeButtons[MAX_BUTTON_GROUPS]; // button IDs, BUTTON_NONE if off
+} binStateFrame_t;
+
+const size_t BIN_MAX_WRITE_FRAME = sizeof(binWriteHeader_t) +
+    BIN_MAX_WRITE_OPS * sizeof(binWriteOp_t);
+
+static_assert(sizeof(binWriteOp_t) == 4, "binWriteOp_t layout changed");
+static_assert(sizeof(binStateFrame_t) == 16 + 2 * OUTPUT_GROUP_COUNT + 2 * MAX_BUTTON_GROUPS,
+    "binStateFrame_t layout changed");
+
+#endif // BINARY_FRAME_H
@@ -0,0 +1,83 @@
+#ifndef BOARD_DESC_H
+#define BOARD_DESC_H
+
+#include <stdint.h>
+
+#include "ioControllerTypes.h"
+
+// Compile-time description of the board's output banks.
+// Every group is a contiguous range of bits on one PCA9555,
+// masks are computed by the compiler.
+
+typedef struct {
+    antControllerIoType_t ioType;
+    expIndex_t exp;
+    uint8_t width;
+    uint8_t offs;
+    uint16_t bitMask; // group bits, as seen by the API
+    uint16_t regMask; // group bits in the expander register
+} outputGroupDesc_t;
+
+template <antControllerIoType_t TYPE, expIndex_t EXP, int WIDTH, int OFFS>
+struct OutputGroupDef {
+    static_assert(isOutputType(TYPE), "not an output type");
+    static_assert((WIDTH > 0) && (OFFS >= 0) && (WIDTH + OFFS <= 16),
+        "group does not fit in a PCA9555 register");
+
+    static constexpr uint16_t bitMask = (uint16_t)((1UL << WIDTH) - 1);
+    static constexpr outputGroupDesc_t desc = {
+        TYPE, EXP, WIDTH, OFFS, bitMask, (uint16_t)(bitMask << OFFS)
+    };
+};
+
+namespace antcontroller_r10 {
+    constexpr uint8_t EXPANDER_ADDR[EXP_COUNT] = {
+        0x20, // EXP_MOSFETS
+        0x21, // EXP_RELAYS
+        0x22  // EXP_OPTO_TTL
+    };
+
+    constexpr outputGroupDesc_t OUTPUTS[] = {
+        OutputGroupDef<MOSFET, EXP_MOSFETS,  16, 0>::desc,
+        OutputGroupDef<RELAY,  EXP_RELAYS,   15, 0>::desc,
+        OutputGroupDef<OPTO,   EXP_OPTO_TTL,  8, 8>::desc,
+        OutputGroupDef<TTL,    EXP_OPTO_TTL,  8, 0>::desc,
+    };
+
+    // output registers of the safe (panic) state - all outputs off,
+    // which also turns off every button group
+    constexpr uint16_t SAFE_WORDS[EXP_COUNT] = {
+        0x0000, // EXP_MOSFETS
+        0x0000, // EXP_RELAYS
+        0x0000  // EXP_OPTO_TTL
+    };
+}
+
+namespace board = antcontroller_r10;
+
+// output types come first in antControllerIoType_t
+const int OUTPUT_GROUP_COUNT = INP;
+
+constexpr bool boardOutputsValid(){
+    if (sizeof(board::OUTPUTS) / sizeof(board::OUTPUTS[0]) != OUTPUT_GROUP_COUNT){
+        return false;
+    }
+    for (int i = 0; i < OUTPUT_GROUP_COUNT; i++){
+        // table must be indexable by antControllerIoType_t
+        if (board::OUTPUTS[i].ioType != i){
+            return false;
+        }
+        // groups sharing an expander must not overlap
+        for (int j = 0; j < i; j++){
+            if ((board::OUTPUTS[i].exp == board::OUTPUTS[j].exp) &&
+                (board::OUTPUTS[i].regMask & board::OUTPUTS[j].regMask)){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+static_assert(boardOutputsValid(),
+    "board outputs must cover every output type, in order, without overlaps");
+
+#endif // BOARD_DESC_H
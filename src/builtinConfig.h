@@ -0,0 +1,120 @@
+#ifndef BUILTIN_CONFIG_H
+#define BUILTIN_CONFIG_H
+
+#include <stdint.h>
+
+#include "ioControllerTypes.h"
+#include "boardDesc.h"
+
+// Built-in fallback config - data/buttons_simple.conf, turned into
+// constant tables by gen_builtin_config.py before every build. The
+// tables live in flash, so the fallback needs neither the filesystem
+// nor the TOML parser, and output masks are computed by the compiler.
+// The source text is kept in flash too, for the frontend.
+
+typedef struct {
+    const char* name;
+    const char* sch;
+    antControllerIoType_t ioType;
+    int ioNum;
+    inputFilterMode_t filterMode;
+    int assertMs;
+    int deassertMs;
+} builtinPin_t;
+
+typedef struct {
+    const char* name;
+    uint16_t groupId;
+    uint16_t firstPin;      // in BUTTON_PINS
+    uint16_t pinCount;
+} builtinButton_t;
+
+typedef struct {
+    uint16_t pinId;
+    uint16_t buttonId;
+    bool onHigh;
+} builtinGuard_t;
+
+#include "builtinConfigData.h"
+
+namespace builtin {
+
+// Config_::config_filename of the built-in config - not a LittleFS
+// path, /api/config serves SOURCE for it
+constexpr char NAME[] = "<builtin>";
+
+// the checks Config_ does while parsing, at compile time
+constexpr bool pinsValid(){
+    const int maxMs = INPUT_FILTER_MAX_TICKS * INPUT_FILTER_TICK_MS;
+    for (int i = 0; i < PIN_COUNT; i++){
+        const builtinPin_t& pin = PINS[i];
+        int width = isOutputType(pin.ioType) ?
+            board::OUTPUTS[pin.ioType].width : INPUT_GUARD_BITS;
+        if ((pin.ioNum < 0) || (pin.ioNum >= width)){
+            return false;
+        }
+        if ((pin.assertMs < 0) || (pin.assertMs > maxMs) ||
+            (pin.deassertMs < 0) || (pin.deassertMs > maxMs)){
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(pinsValid(), "built-in config: pin out of range, or debounce too long");
+
+constexpr bool buttonsValid(){
+    if (GROUP_COUNT > MAX_BUTTON_GROUPS){
+        return false;
+    }
+    for (int i = 0; i < BUTTON_COUNT; i++){
+        const builtinButton_t& b = BUTTONS[i];
+        if ((b.groupId >= GROUP_COUNT) || (b.firstPin + b.pinCount > BUTTON_PIN_COUNT)){
+            return false;
+        }
+        for (int p = b.firstPin; p < b.firstPin + b.pinCount; p++){
+            if ((BUTTON_PINS[p] >= PIN_COUNT) || !isOutputType(PINS[BUTTON_PINS[p]].ioType)){
+                return false;
+            }
+        }
+    }
+    for (int i = 0; i < GUARD_COUNT; i++){
+        if ((GUARDS[i].pinId >= PIN_COUNT) || (GUARDS[i].buttonId >= BUTTON_COUNT)){
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(buttonsValid(), "built-in config: invalid button, or a button pin is not an output");
+
+typedef struct {
+    outputTransaction_t buttons[BUTTON_COUNT ? BUTTON_COUNT : 1];
+    outputTransaction_t groupReset[GROUP_COUNT ? GROUP_COUNT : 1];
+} outputTables_t;
+
+// same as Config_::compileOutputMask()
+constexpr void setOutput(outputTransaction_t& tx, const builtinPin_t& pin, bool val){
+    const outputGroupDesc_t& desc = board::OUTPUTS[pin.ioType];
+    uint16_t bit = (uint16_t)0x01 << (pin.ioNum + desc.offs);
+    tx.mask[desc.exp] |= bit;
+    if (val){
+        tx.bits[desc.exp] |= bit;
+    }
+}
+
+constexpr outputTables_t compileOutputs(){
+    outputTables_t t = {};
+    for (int i = 0; i < BUTTON_COUNT; i++){
+        const builtinButton_t& b = BUTTONS[i];
+        for (int p = b.firstPin; p < b.firstPin + b.pinCount; p++){
+            setOutput(t.buttons[i], PINS[BUTTON_PINS[p]], true);
+            setOutput(t.groupReset[b.groupId], PINS[BUTTON_PINS[p]], false);
+        }
+    }
+    return t;
+}
+
+constexpr outputTables_t OUTPUTS = compileOutputs();
+
+} // namespace builtin
+
+#endif // BUILTIN_CONFIG_H
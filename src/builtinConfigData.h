@@ -0,0 +1,143 @@
+// Generated by gen_builtin_config.py from data/buttons_simple.conf - do not edit.
+// Included by builtinConfig.h only.
+
+namespace builtin {
+
+constexpr int PIN_COUNT = 6;
+constexpr int GROUP_COUNT = 4;
+constexpr int BUTTON_COUNT = 8;
+constexpr int BUTTON_PIN_COUNT = 10;
+constexpr int GUARD_COUNT = 2;
+
+constexpr builtinPin_t PINS[] = {
+    {"OC1", "OC1", OPTO, 0, FILTER_DEBOUNCE, 0, 0},
+    {"OC2", "OC2", OPTO, 1, FILTER_DEBOUNCE, 0, 0},
+    {"SINK1", "SINK1", MOSFET, 0, FILTER_DEBOUNCE, 0, 0},
+    {"SINK2", "SINK2", MOSFET, 1, FILTER_DEBOUNCE, 0, 0},
+    {"RL1", "RL1", RELAY, 0, FILTER_DEBOUNCE, 0, 0},
+    {"RL2", "RL2", RELAY, 1, FILTER_DEBOUNCE, 0, 0},
+};
+
+constexpr const char* GROUPS[] = {
+    "a",
+    "b",
+    "c",
+    "d",
+};
+
+constexpr builtinButton_t BUTTONS[] = {
+    {"A1", 0, 0, 1},
+    {"A2", 0, 1, 1},
+    {"B1", 1, 2, 1},
+    {"B2", 1, 3, 1},
+    {"C1", 2, 4, 2},
+    {"C2", 2, 6, 2},
+    {"ROT LEFT", 3, 8, 1},
+    {"ROT RIGHT", 3, 9, 1},
+};
+
+constexpr uint16_t BUTTON_PINS[] = {
+    0,
+    1,
+    2,
+    3,
+    4,
+    5,
+    4,
+    5,
+    4,
+    5,
+};
+
+constexpr builtinGuard_t GUARDS[] = {
+    {0, 4, false},
+    {1, 4, false},
+};
+
+constexpr char SOURCE[] =
+    "version = \"0.1.8\"\n"
+    "\n"
+    "\n"
+    "[[pin]]\n"
+    "sch =     \"OC1\"\n"
+    "antctrl = \"OC1\"\n"
+    "name =    \"OC1\"\n"
+    "descr =   \"\"\n"
+    "\n"
+    "[[pin]]\n"
+    "sch =     \"OC2\"\n"
+    "antctrl = \"OC2\"\n"
+    "name =    \"OC2\"\n"
+    "descr =   \"\"\n"
+    "\n"
+    "[[pin]]\n"
+    "sch =     \"SINK1\"\n"
+    "antctrl = \"SINK1\"\n"
+    "name =    \"SINK1\"\n"
+    "descr =   \"\"\n"
+    "\n"
+    "[[pin]]\n"
+    "sch =     \"SINK2\"\n"
+    "antctrl = \"SINK2\"\n"
+    "name =    \"SINK2\"\n"
+    "descr =   \"\"\n"
+    "\n"
+    "[[pin]]\n"
+    "sch =     \"RL1\"\n"
+    "antctrl = \"RL1\"\n"
+    "name =    \"RL1\"\n"
+    "descr =   \"\"\n"
+    "\n"
+    "[[pin]]\n"
+    "sch =     \"RL2\"\n"
+    "antctrl = \"RL2\"\n"
+    "name =    \"RL2\"\n"
+    "descr =   \"\"\n"
+    "\n"
+    "[buttons]\n"
+    "\n"
+    "[[buttons.a]]\n"
+    "name =  \"A1\"\n"
+    "descr = \"descr_A1\"\n"
+    "pins = [ \"OC1\" ]\n"
+    "\n"
+    "[[buttons.a]]\n"
+    "name =  \"A2\"\n"
+    "api = \"api_A2\"\n"
+    "descr = \"descr_A2\"\n"
+    "pins = [ \"OC2\" ]\n"
+    "\n"
+    "[[buttons.b]]\n"
+    "name =  \"B1\"\n"
+    "api = \"B1\"\n"
+    "descr = \"\"\n"
+    "pins = [ \"SINK1\" ]\n"
+    "\n"
+    "[[buttons.b]]\n"
+    "name =  \"B2\" \n"
+    "api = \"B2\"\n"
+    "descr = \"\"\n"
+    "pins = [ \"SINK2\" ]\n"
+    "\n"
+    "[[buttons.c]]\n"
+    "name =  \"C1\"\n"
+    "descr = \"\"\n"
+    "pins = [ \"RL1\", \"RL2\" ]\n"
+    "disable_on_low = [\"OC1\", \"OC2\"]\n"
+    "\n"
+    "[[buttons.c]]\n"
+    "name =  \"C2\"\n"
+    "descr = \"\"\n"
+    "pins = [ \"RL1\", \"RL2\" ]\n"
+    "\n"
+    "[[buttons.d]]\n"
+    "name =  \"ROT LEFT\"\n"
+    "descr = \"- azymut\"\n"
+    "pins = [ \"RL1\" ]\n"
+    "\n"
+    "[[buttons.d]]\n"
+    "name =  \"ROT RIGHT\"\n"
+    "descr = \"+ azymut\"\n"
+    "pins = [ \"RL2\" ]";
+
+} // namespace builtin
@@ -1,206 +1,307 @@
-
 #include "buttonHandler.h"
 
 #include "configHandler.h"
 #include "alfalog.h"
+#include "traceSpan.h"
 
 #include "ioController.h"
 
-void addUniquePin(std::vector<pin_t>& pins, const pin_t& newPin) {
-    auto it = std::find_if(pins.begin(), pins.end(), [&newPin](const pin_t& pin) {
-        return pin.ioType == newPin.ioType && pin.ioNum == newPin.ioNum;
-    });
-
-    if (it == pins.end()) {
-        pins.push_back(newPin);
-    }
-}
-
-void logPinNames(std::string pre, const std::vector<pin_t>& pins) {
-    std::vector<std::string> pinNames;
-    for (const auto& pin : pins) {
-        pinNames.push_back(pin.name);
-    }
-    ALOGI("{}: {}",pre, fmt::join(pinNames, ", "));
-}
-
-void ButtonHandler::getState(DynamicJsonDocument& jsonRef){
+void ButtonHandler::getState(JsonDocument& jsonRef){
     JsonObject buttonHandlerData = jsonRef.createNestedObject("buttons");
     // buttonHandlerData["status"] = "OK";
     JsonObject buttonJson = buttonHandlerData.createNestedObject("groups");
 
-    for(auto& bGroup: Config.button_groups){
-        buttonJson[bGroup.first] = bGroup.second.currentButtonName;
+    for (int i = 0; i < ConfigStore.active().button_groups.size(); i++){
+        appendGroupState(buttonJson, i);
     }
     return;
 }
 
-void ButtonHandler::resetOutputsForButtonGroup(const std::string& bGroup){
-    // for (auto pin: Config.pins_by_group[bGroup]){
-    //     ioController->setOutput(pin->ioType, pin->ioNum, false);
-    // }
-    ALOGD("resetting outputs for group {}", bGroup.c_str());
-    std::vector<pin_t> pinsToTurnOff;
+// same layout as getState(), only groups set in groupMask
+void ButtonHandler::getGroupState(JsonDocument& jsonRef, uint32_t groupMask){
+    JsonObject buttonHandlerData = jsonRef.createNestedObject("buttons");
+    JsonObject buttonJson = buttonHandlerData.createNestedObject("groups");
 
-    for (auto& button: Config.button_groups[bGroup].buttons){
-        for (auto& pinName: button.pinNames){
-            const pin_t pin = Config.getPinByName(pinName);
-            addUniquePin(pinsToTurnOff, pin);
+    while (groupMask != 0){
+        int groupId = __builtin_ctz(groupMask);
+        groupMask &= groupMask - 1;
+        if (groupId < ConfigStore.active().button_groups.size()){
+            appendGroupState(buttonJson, groupId);
         }
     }
-    logPinNames("turning off pins", pinsToTurnOff);
-    for (auto& pin: pinsToTurnOff){
-        ioController->setOutput(pin.ioType, pin.ioNum, false);
+}
+
+void ButtonHandler::appendGroupState(JsonObject& buttonJson, uint16_t groupId){
+    const Config_& cfg = ConfigStore.active();
+    const buttonGroup_t& bGroup = cfg.button_groups[groupId];
+    if (activeButtons[groupId] == BUTTON_NONE){
+        buttonJson[bGroup.name.c_str()] = "OFF";
+    } else {
+        buttonJson[bGroup.name.c_str()] = cfg.buttons[activeButtons[groupId]].name.c_str();
     }
-    Config.button_groups[bGroup].currentButtonName = "OFF";
 }
 
-bool ButtonHandler::setButton(button_t button, bool targetState){
-    for (auto& bg: Config.button_groups){
-        for (auto& b: bg.second.buttons){
-            if (b.name == button.name){
-                if (targetState){
-                    return activateButtonFromGroup(bg.first, b);
-                } else {
-                    resetOutputsForButtonGroup(bg.first);
-                    return true;
-                }
-            }
-        }
+void ButtonHandler::setActiveButton(uint16_t groupId, int buttonId){
+    if (activeButtons[groupId] != buttonId){
+        activeButtons[groupId] = buttonId;
+        ioController->markStateDirty(0, (uint32_t)0x01 << groupId);
     }
-    ALOGE("button {} not found", button.name.c_str());
-    return false;
 }
 
-bool ButtonHandler::getButton(button_t button, bool* gottenState){
-    for (auto& bg: Config.button_groups){
-        for (auto& b: bg.second.buttons){
-            if (b.name == button.name){
-                *gottenState = (bg.second.currentButtonName == button.name);
-                return true;
-            }
-        }
+int ButtonHandler::getActiveButton(uint16_t groupId){
+    return activeButtons[groupId];
+}
+
+void ButtonHandler::stageGroupReset(outputTransaction_t& tx, uint16_t groupId){
+    stageTransaction(tx, ConfigStore.active().button_groups[groupId].reset);
+}
+
+bool ButtonHandler::resetOutputsForButtonGroup(uint16_t groupId, i2cLane_t lane){
+    outputTransaction_t tx = ioController->beginTransaction();
+    stageGroupReset(tx, groupId);
+    bool isOk = ioController->commitTransaction(tx, lane);
+    setActiveButton(groupId, BUTTON_NONE);
+    return isOk;
+}
+
+// outputs are already off - only after writing the safe state
+void ButtonHandler::clearActiveButtons(){
+    for (int i = 0; i < ConfigStore.active().button_groups.size(); i++){
+        setActiveButton(i, BUTTON_NONE);
     }
-    ALOGE("button {} not found", button.name.c_str());
-    return false;
-}
-
-bool ButtonHandler::activateButtonFromGroup(const std::string& bGroupName, button_t button){
-    ALOGI("activate button {} in group {}", button.name, bGroupName);
-    resetOutputsForButtonGroup(bGroupName);
-
-    //translate button pin names to pin objects for easier operation
-    std::vector<pin_t> pinsToActivate;
-    for (auto& pinName: button.pinNames){
-        const pin_t pin = Config.getPinByName(pinName);
-        addUniquePin(pinsToActivate, pin);
-    }
-
-    // works unreliably currently, disable for now
-
-    // // assert buttons guarded by to-be enabled pins
-    // for (auto& pin: pinsToActivate){
-    //     for (auto& pinGuard: pin.pinGuards){
-    //         ALOGI("Checking pin: '{}'", pin.to_string().c_str());
-    //         if (pinGuard.guardedButton == button.name){
-    //             ALOGW("button '{}' is prevented by pin '{}' value!",
-    //                 pinGuard.guardedButton, pin.name)
-    //             return false;
-    //         } else {
-    //             ALOGW("button '{}' is being turned off", pinGuard.guardedButton)
-    //             setButton(Config.getButtonByName(pinGuard.guardedButton),false);
-    //         }
-    //     }
-    // }
-    //then activate the pins
-    logPinNames("turning on pins", pinsToActivate);
-    for (auto& pin: pinsToActivate){
-        this->ioController->setOutput(pin.ioType, pin.ioNum, true);
-    }
-    Config.button_groups[bGroupName].currentButtonName = button.name;
-
-    recheckPinGuards();
-    return true;
 }
 
-bool ButtonHandler::recheckPinGuards(bool inputOnly){
-    auto guards = Config.gatherGuards(inputOnly);
+bool ButtonHandler::setButton(uint16_t buttonId, bool targetState, i2cLane_t lane){
+    const Config_& cfg = ConfigStore.active();
+    if (buttonId >= cfg.buttons.size()){
+        ALOGE("button {} not found", buttonId);
+        return false;
+    }
+    if (targetState){
+        return activateButton(buttonId);
+    } else {
+        return resetOutputsForButtonGroup(cfg.buttons[buttonId].groupId, lane);
+    }
+}
 
-    for (auto& [pin, guard]: guards){
-        // 1. Ignore output pins if needed
-        if (inputOnly && pin.ioType != INP){
-            continue;
-        }
-        // 2. Assert that this guard is activated
-        bool pinValue = ioController->getIoValue(pin.ioType, pin.ioNum);
-        if (pinValue != guard.onHigh){
-            continue;
-        }
-        // 3. Check if the guarded button is active
-        button_t currentButton = Config.getButtonByName(guard.guardedButton);
-
-        bool isHigh;
-        if (getButton(currentButton, &isHigh)){
-            if (isHigh){
-                ALOGW("pin |{}| is |{}|, guarding button |{}|, turn off",
-                    pin.name, pinValue?"high":"low", guard.guardedButton);
-                setButton(currentButton, false);
-            }
-        }
+bool ButtonHandler::getButton(uint16_t buttonId, bool* gottenState){
+    const Config_& cfg = ConfigStore.active();
+    if (buttonId >= cfg.buttons.size()){
+        ALOGE("button {} not found", buttonId);
+        return false;
     }
+    *gottenState = (activeButtons[cfg.buttons[buttonId].groupId] == buttonId);
     return true;
 }
 
-bool ButtonHandler::apiAction(std::vector<std::string>& api_call){
-    ALOGT("API call for buttonHandler");
+// expander registers after committing both transactions, and the INP word
+void ButtonHandler::predictPorts(uint16_t ports[GUARD_PORT_COUNT],
+        const outputTransaction_t& breakTx, const outputTransaction_t& makeTx){
+    ioController->getOutputWords(ports);
+    ioController->applyTransaction(breakTx, ports);
+    ioController->applyTransaction(makeTx, ports);
+    ports[GUARD_PORT_INP] = ioController->getGroupBits(INP);
+}
 
-    if (api_call.size() < 3){
+bool ButtonHandler::activateButton(uint16_t buttonId){
+    buttonPlan_t plan;
+    beginPlan(plan);
+    planButton(plan, ConfigStore.active().buttons[buttonId].groupId, buttonId);
+    if (checkPlan(plan) != BUTTON_NONE){
         return false;
     }
-    std::string buttonGroup = api_call[1];
-    std::string buttonName = api_call[2];
+    return commitPlan(plan);
+}
 
-    if (Config.button_groups.count(buttonGroup) == 0){
-        ALOGI("button group {} not found", buttonGroup);
-        return false;
+void ButtonHandler::beginPlan(buttonPlan_t& plan){
+    plan.breakTx = ioController->beginTransaction();
+    plan.makeTx = ioController->beginTransaction();
+    plan.groups = 0;
+}
+
+// stages turning buttonId on (or the group off, for BUTTON_NONE),
+// on top of changes already in the plan - later changes win
+void ButtonHandler::planButton(buttonPlan_t& plan, uint16_t groupId, int buttonId){
+    stageGroupReset(plan.breakTx, groupId);
+    stageGroupReset(plan.makeTx, groupId);
+    if (buttonId != BUTTON_NONE){
+        stageTransaction(plan.makeTx, ConfigStore.active().buttons[buttonId].outputs);
     }
+    plan.groups |= (uint32_t)0x01 << groupId;
+    plan.activeButtons[groupId] = buttonId;
+}
 
-    if (buttonName == "OFF"){
-        resetOutputsForButtonGroup(buttonGroup);
-        return true;
+// Interlock - the planned state is checked before anything is written.
+// Active buttons conflicting with it are added to the plan, to be turned
+// off in the "break" commit. Returns the planned button prevented by its
+// guards, or BUTTON_NONE if the plan may be committed.
+int ButtonHandler::checkPlan(buttonPlan_t& plan){
+    const Config_& cfg = ConfigStore.active();
+    uint16_t ports[GUARD_PORT_COUNT];
+    predictPorts(ports, plan.breakTx, plan.makeTx);
+
+    bool isConflict = true;
+    while (isConflict){
+        // turning a button off may trigger "disable_on_low" guards of another
+        isConflict = false;
+        for (int i = 0; i < cfg.button_groups.size(); i++){
+            int activeButton = activeButtons[i];
+            if ((activeButton == BUTTON_NONE) || ((plan.groups >> i) & 0x01)){
+                continue;
+            }
+            if (isGuardViolated(cfg.buttons[activeButton].guardMask, ports)){
+                ALOGW("button '{}' is in conflict with the new state, turn off",
+                    cfg.buttons[activeButton].name);
+                stageGroupReset(plan.breakTx, i);
+                plan.groups |= (uint32_t)0x01 << i;
+                plan.activeButtons[i] = BUTTON_NONE;
+                predictPorts(ports, plan.breakTx, plan.makeTx);
+                isConflict = true;
+            }
+        }
     }
 
-    for (auto &b: Config.button_groups[buttonGroup].buttons){
-        ALOGT("checking button '{}'", b.name.c_str());
-        if (b.name == buttonName){
-            return activateButtonFromGroup(buttonGroup, b);
+    uint32_t pending = plan.groups;
+    while (pending != 0){
+        int groupId = __builtin_ctz(pending);
+        pending &= pending - 1;
+        int buttonId = plan.activeButtons[groupId];
+        if ((buttonId != BUTTON_NONE) &&
+            isGuardViolated(cfg.buttons[buttonId].guardMask, ports)){
+            ALOGW("button '{}' is prevented by pin guards!", cfg.buttons[buttonId].name);
+            return buttonId;
         }
     }
-    ALOGI("button {} not found", api_call[1].c_str());
-    return false;
+    return BUTTON_NONE;
 }
 
+// Returns false if an expander write failed. Nothing is made, if the
+// break phase failed - the old outputs may still be on. Groups of the
+// plan are left off on failure, their outputs may not be written.
+bool ButtonHandler::commitPlan(buttonPlan_t& plan){
+    // everything the "make" phase turns off, goes off in the "break" phase
+    for (int i = 0; i < EXP_COUNT; i++){
+        uint16_t offMask = plan.makeTx.mask[i] & ~plan.makeTx.bits[i];
+        plan.breakTx.mask[i] |= offMask;
+        plan.breakTx.bits[i] &= ~offMask;
+    }
 
+    // a single state update for both phases
+    ioController->holdStateUpdates(true);
 
+    // "break", the dead-time and "make" are a single bus job
+    bool isOk = ioController->commitBreakMake(plan.breakTx, plan.makeTx);
+    uint32_t pending = plan.groups;
+    while (pending != 0){
+        int groupId = __builtin_ctz(pending);
+        pending &= pending - 1;
+        setActiveButton(groupId, isOk ? plan.activeButtons[groupId] : BUTTON_NONE);
+    }
 
-    // for (auto& pin: Config.pins){
-    //     if (pin.ioType != INP){
-    //         if (inputOnly) continue;
-    //     }
+    ioController->holdStateUpdates(false);
+    return isOk;
+}
 
-    //     for (auto& guard: pin.pinGuards){
-    //         if (ioController->getIoValue(pin.ioType, pin.ioNum) != guard.onHigh){
-    //             continue;
-    //         }
-    //         button_t currentButton = Config.getButtonByName(guard.guardedButton);
+// Runs right after a config swap. Active buttons are carried over to
+// the new config by group and button name, and only outputs that differ
+// are written - pins of the old buttons not driven by a remapped one go
+// off in the "break" commit, pins driven by both are not touched.
+void ButtonHandler::remapButtons(const Config_& old){
+    const Config_& cfg = ConfigStore.active();
+    outputTransaction_t oldOn = {};
+    int16_t remapped[MAX_BUTTON_GROUPS];
+    std::fill(remapped, remapped + MAX_BUTTON_GROUPS, BUTTON_NONE);
 
-    //         bool isHigh;
-    //         if (getButton(currentButton, &isHigh)){
-    //             if (isHigh){
-    //                 ALOGW("pin {} is in wrong state for button {}, turn off",
-    //                     pin.name, guard.guardedButton);
-    //                 setButton(currentButton, false);
-    //             }
-    //         }
-    //     }
-    // }
\ No newline at end of file
+    for (int i = 0; i < old.button_groups.size(); i++){
+        int buttonId = activeButtons[i];
+        activeButtons[i] = BUTTON_NONE;
+        if (buttonId == BUTTON_NONE){
+            continue;
+        }
+        const button_t& button = old.buttons[buttonId];
+        stageTransaction(oldOn, button.outputs);
+
+        int groupId = cfg.findGroup(old.button_groups[i].name);
+        int newId = (groupId < 0) ? -1 : cfg.findButton(groupId, button.name);
+        if (newId < 0){
+            ALOGW("button '{}' is not in the new config, turn off", button.name);
+            continue;
+        }
+        remapped[groupId] = newId;
+    }
+
+    buttonPlan_t plan;
+    int prevented;
+    do {
+        beginPlan(plan);
+        for (int i = 0; i < EXP_COUNT; i++){
+            plan.makeTx.mask[i] = oldOn.bits[i];
+        }
+        for (int i = 0; i < cfg.button_groups.size(); i++){
+            if (remapped[i] != BUTTON_NONE){
+                stageTransaction(plan.makeTx, cfg.buttons[remapped[i]].outputs);
+                plan.groups |= (uint32_t)0x01 << i;
+                plan.activeButtons[i] = remapped[i];
+            }
+        }
+        // guards may have changed as well
+        prevented = checkPlan(plan);
+        if (prevented != BUTTON_NONE){
+            remapped[cfg.buttons[prevented].groupId] = BUTTON_NONE;
+        }
+    } while (prevented != BUTTON_NONE);
+
+    commitPlan(plan);
+}
+
+// Evaluates only guards of the inputs in changedBits,
+// using the lists compiled by Config_::compileGuards(). All the
+// guarded groups are reset by a single bus job, so the job stays
+// within the panic reaction bound (see safetyBound.h).
+void ButtonHandler::checkInputGuards(uint16_t inputBits, uint16_t changedBits){
+    TraceSpan span(SPAN_PIN_GUARDS);
+    const Config_& cfg = ConfigStore.active();
+    uint16_t pending = changedBits & cfg.guardedInputs;
+    outputTransaction_t tx = ioController->beginTransaction();
+    uint32_t resetGroups = 0;
+
+    while (pending != 0){
+        int input = __builtin_ctz(pending);
+        pending &= pending - 1;
+
+        bool level = (inputBits >> input) & 0x01;
+        for (auto& guard: cfg.inputGuards[input]){
+            if (guard.onHigh != level){
+                continue;
+            }
+            const button_t& button = cfg.buttons[guard.buttonId];
+            if (activeButtons[button.groupId] == guard.buttonId){
+                ALOGW("input |{}| is |{}|, guarding button |{}|, turn off",
+                    input + 1, level?"high":"low", button.name);
+                stageGroupReset(tx, button.groupId);
+                resetGroups |= (uint32_t)0x01 << button.groupId;
+            }
+        }
+    }
+    if (resetGroups == 0){
+        return;
+    }
+    if (!ioController->commitTransaction(tx, I2C_LANE_SAFETY)){
+        ioController->recordSafetyWriteFailure("input guard");
+    }
+    // the shadow already holds the reset, resync re-asserts it
+    while (resetGroups != 0){
+        setActiveButton(__builtin_ctz(resetGroups), BUTTON_NONE);
+        resetGroups &= resetGroups - 1;
+    }
+}
+
+// Activation path is allocation free (see allocTracker.h) - log
+// formatting allocates, so only failures and conflicts are logged.
+// cmd is already resolved into IDs by parseApiCommand().
+bool ButtonHandler::apiAction(const apiCommand_t& cmd){
+    if (cmd.value == BUTTON_NONE){
+        return resetOutputsForButtonGroup(cmd.index);
+    }
+    return activateButton(cmd.value);
+}
@@ -2,12 +2,13 @@
 #pragma once
 
 
-#include <vector>
-#include <string>
 #include "ioControllerTypes.h"
+#include "apiCommand.h"
 #include "ArduinoJson.h"
+#include "i2cBus.h"
 
 class IoController;
+class Config_;
 
 class ButtonHandler {
 
@@ -16,17 +17,35 @@ public:
     ButtonHandler() = delete;
     ButtonHandler(IoController* ioController){
         this->ioController = ioController;
+        std::fill(activeButtons, activeButtons + MAX_BUTTON_GROUPS, BUTTON_NONE);
     }
 
-    bool apiAction(std::vector<std::string>& api_call);
-    void resetOutputsForButtonGroup(const std::string& bGroup);
-    bool activateButtonFromGroup(const std::string& bGroup, button_t button);
-    bool setButton(button_t button, bool targetState);
-    bool getButton(button_t button, bool* gottenState);
-    void getState(DynamicJsonDocument& jsonRef);
-    bool recheckPinGuards(bool inputOnly = false);
+    bool apiAction(const apiCommand_t& cmd);
+    bool resetOutputsForButtonGroup(uint16_t groupId, i2cLane_t lane = I2C_LANE_API);
+    void stageGroupReset(outputTransaction_t& tx, uint16_t groupId);
+    void clearActiveButtons();
+    int getActiveButton(uint16_t groupId);
+    void remapButtons(const Config_& old);
+    bool activateButton(uint16_t buttonId);
+
+    void beginPlan(buttonPlan_t& plan);
+    void planButton(buttonPlan_t& plan, uint16_t groupId, int buttonId);
+    int checkPlan(buttonPlan_t& plan);
+    bool commitPlan(buttonPlan_t& plan);
+
+    bool setButton(uint16_t buttonId, bool targetState, i2cLane_t lane = I2C_LANE_API);
+    bool getButton(uint16_t buttonId, bool* gottenState);
+    void getState(JsonDocument& jsonRef);
+    void getGroupState(JsonDocument& jsonRef, uint32_t groupMask);
+    void checkInputGuards(uint16_t inputBits, uint16_t changedBits);
+    void predictPorts(uint16_t ports[GUARD_PORT_COUNT],
+        const outputTransaction_t& breakTx, const outputTransaction_t& makeTx);
 
 private:
-    std::string tag;
-    std::vector<uint8_t> pins;
+    void appendGroupState(JsonObject& buttonJson, uint16_t groupId);
+    void setActiveButton(uint16_t groupId, int buttonId);
+
+    // button state is kept apart from the config, which is immutable -
+    // indexed by group id of the active config
+    int16_t activeButtons[MAX_BUTTON_GROUPS];
 };
\ No newline at end of file
@@ -14,7 +14,7 @@ typedef std::function<void(std::string)> ClitussiCallback;
 class clitussiStub {
 
 private:
-    const int clitussyDepth = 40;
+    const int clitussyDepth = 160;
     std::vector<char> buf;
 
     std::map<std::string, ClitussiCallback> Callbacks;
@@ -1,48 +1,184 @@
 #include "configHandler.h"
 #include "gracefulRestart.h"
+#include "configImage.h"
+#include "builtinConfig.h"
 
-Config_ &Config = Config.getInstance();
+ConfigStore_ &ConfigStore = ConfigStore.getInstance();
 
-const char CONFIG_FALLBACK[] = "/buttons_simple.conf";
-
-static bool loadDefault(const char *name){
-    Config.clearPresets();
-    if (Config.loadConfig("/pins.conf") == false){
+static bool loadDefault(Config_& config, const char *name){
+    config.clearPresets();
+    if (config.loadConfig("/pins.conf") == false){
         return false;
     }
-    if (Config.loadConfig(name) == false){
+    if (config.loadConfig(name) == false){
         return false;
     }
-    Config.config_filename = name; //frontend only needs button config
+    config.config_filename = name; //frontend only needs button config
     return true;
 }
 
-static bool loadFallback(){
-    Config.clearPresets();
-    if (Config.loadConfig(CONFIG_FALLBACK) == false){
-        ALOGW("WARNING - Fallback config failed.");
-        return false;
-    } else {
-        ALOGW("WARNING - Fallback config loaded.");
-        Config.config_filename = CONFIG_FALLBACK;
-        return true;
+static uint32_t hashFile(uint32_t hash, const char* name){
+    hash = configHash(hash, name, strlen(name) + 1);
+    File file = LittleFS.open(name, "r", false);
+    if (!file){
+        return hash;
     }
+    uint8_t buf[256];
+    size_t len;
+    while ((len = file.read(buf, sizeof(buf))) > 0){
+        hash = configHash(hash, buf, len);
+    }
+    file.close();
+    return hash;
+}
+
+// sources of loadDefault(), and the firmware that compiled them
+static uint32_t configSourceHash(const char* name){
+    uint32_t hash = CONFIG_HASH_SEED;
+#ifdef FW_REV
+    hash = configHash(hash, FW_REV, sizeof(FW_REV));
+#endif
+    hash = hashFile(hash, "/pins.conf");
+    return hashFile(hash, name);
 }
 
 // vTaskDelete may prevent resource freeing
-static void configRAIIScope(const char* config){    
-    if (loadDefault(config) == false){
-        loadFallback();
+static void configRAIIScope(const char* name){
+    // hashed first, so a file changed while parsing is parsed again
+    uint32_t sourceHash = configSourceHash(name);
+    // the current config stays in use until this one is complete
+    std::shared_ptr<Config_> next = std::make_shared<Config_>();
+    if (loadDefault(*next, name) == false){
+        // a broken file doesn't replace a working config
+        if (!ConfigStore.get()->is_valid){
+            ConfigStore.loadBuiltin();
+        } else {
+            ALOGE("Failed to load {}, keeping {}", name, ConfigStore.get()->config_filename);
+        }
         return;
     }
+    next->storeCompiledConfig(sourceHash);
+    ConfigStore.publish(next);
+}
+
+bool Config_::loadCompiledConfig(const char* name){
+    TraceSpan span(SPAN_CONFIG_IMAGE);
+    uint32_t startUs = micros();
+    clearPresets();
+    // built from a checked TOML, but the image may come from other firmware
+    if (!ConfigImageStore::load(configSourceHash(name), *this) ||
+            (stateJsonLength() >= API_JSON_CAPACITY)){
+        clearPresets();
+        return false;
+    }
+    ALOGI("Loaded compiled {} in {}us: {} buttons, {} pins",
+        config_filename, micros() - startUs, buttons.size(), pins.size());
+    return true;
+}
+
+// straight from the tables in flash, can't fail
+void Config_::loadBuiltinConfig(){
+    TraceSpan span(SPAN_CONFIG_BUILTIN);
+    clearPresets();
+    pins.reserve(builtin::PIN_COUNT);
+    buttons.reserve(builtin::BUTTON_COUNT);
+    button_groups.reserve(builtin::GROUP_COUNT);
+
+    for (int i = 0; i < builtin::PIN_COUNT; i++){
+        const builtinPin_t& p = builtin::PINS[i];
+        pin_t pin(p.name, p.sch, p.ioType, p.ioNum);
+        pin.filterMode = p.filterMode;
+        pin.assertMs = p.assertMs;
+        pin.deassertMs = p.deassertMs;
+        pins.push_back(pin);
+    }
+    for (int i = 0; i < builtin::GUARD_COUNT; i++){
+        const builtinGuard_t& g = builtin::GUARDS[i];
+        pins[g.pinId].setGuard(g.buttonId, g.onHigh);
+    }
+    for (int i = 0; i < builtin::GROUP_COUNT; i++){
+        buttonGroup_t group;
+        group.name = builtin::GROUPS[i];
+        group.reset = builtin::OUTPUTS.groupReset[i];
+        button_groups.push_back(group);
+    }
+    for (int i = 0; i < builtin::BUTTON_COUNT; i++){
+        const builtinButton_t& b = builtin::BUTTONS[i];
+        button_t button(b.name, i, b.groupId);
+        button.pinIds.assign(builtin::BUTTON_PINS + b.firstPin,
+            builtin::BUTTON_PINS + b.firstPin + b.pinCount);
+        button.outputs = builtin::OUTPUTS.buttons[i];
+        button_groups[b.groupId].buttonIds.push_back(i);
+        buttons.push_back(button);
+    }
+    indexPins();
+    indexButtons();
+    compileGuards();
+
+    config_filename = builtin::NAME;
+    is_valid = true;
+    ALOGW("WARNING - Built-in fallback config loaded.");
+}
+
+void Config_::storeCompiledConfig(uint32_t sourceHash) const {
+    std::vector<uint8_t> image;
+    configImage::build(*this, sourceHash, image);
+    ConfigImageStore::store(image);
 }
 
 void configLoaderTask(void *parameter)
 {
-    //  = (const char*) parameter; 
+    std::string* name = (std::string*)parameter;
     ALOGV("configLoaderTask start");
-    configRAIIScope((const char*) parameter);
+    configRAIIScope(name->c_str());
+    delete name;
 
     ALOGI("TomlTask done. Connecting to WiFi...");
     vTaskDelete(NULL);
+}
+
+void ConfigStore_::load(const char* name){
+    std::shared_ptr<Config_> next = std::make_shared<Config_>();
+    if (next->loadCompiledConfig(name)){
+        publish(next);
+        return;
+    }
+    // copied, the caller's buffer may be reused before the task runs
+    std::string* taskName = new std::string(name);
+    bool taskCreated = xTaskCreate( configLoaderTask, "toml task",
+        100*1000, (void*) taskName, 6, NULL );
+    if (taskCreated != pdPASS) {
+        ALOGE("Failed to create TOML task");
+        delete taskName;
+    }
+}
+
+void ConfigStore_::loadBuiltin(){
+    std::shared_ptr<Config_> next = std::make_shared<Config_>();
+    next->loadBuiltinConfig();
+    publish(next);
+}
+
+void ConfigStore_::attachPublishHook(configPublishFn_t fn, void* arg){
+    publishHookArg = arg;
+    publishHook = fn;
+}
+
+void ConfigStore_::publish(std::shared_ptr<Config_> next){
+    if (publishHook != NULL){
+        publishHook(next, publishHookArg);
+    } else {
+        swap(next);
+    }
+}
+
+// Not reentrant - only called from the publish hook, which runs it on
+// the controller task, or before the hook is attached.
+configSnapshot_t ConfigStore_::swap(std::shared_ptr<Config_> next){
+    configSnapshot_t old = current;
+    next->generation = old->generation + 1;
+    std::atomic_store(&current, configSnapshot_t(next));
+    activeConfig = next.get();
+    ALOGI("Config generation {} published: {}", next->generation, next->config_filename);
+    return old;
 }
\ No newline at end of file
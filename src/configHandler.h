@@ -2,6 +2,7 @@
 #define CONFIG_HANDLER_H
 
 #include <map>
+#include <memory>
 
 #ifdef ESP32
 #include "alfalog.h"
@@ -11,6 +12,9 @@
 #include "toml.hpp"
 
 #include "ioControllerTypes.h"
+#include "boardDesc.h"
+#include "traceSpan.h"
+#include "jsonPool.h"
 #include <fmt/ranges.h>
 
 #define MAX_FILE_SIZE 6000
@@ -35,6 +39,7 @@ public:
 
     void clearPresets(){
         pins.clear();
+        buttons.clear();
         button_groups.clear();
         config_filename = "undefined";
     }
@@ -44,6 +49,7 @@ public:
     // }
 
     bool loadConfig(const char* name){
+        TraceSpan span(SPAN_CONFIG_TOML);
         try{
             File file = LittleFS.open(name, "r", false);
 
@@ -70,7 +76,17 @@ public:
             auto data = toml::parse(istr, name);
             
             int statPinCount = parsePins(data);
+            indexPins();
             int statButtonCount = parseButtons(data);
+            indexButtons();
+            compileGuards();
+
+            if (stateJsonLength() >= API_JSON_CAPACITY){
+                const std::string err = fmt::format(
+                    "state of {} button groups is too long for an API reply",
+                    button_groups.size());
+                throw std::runtime_error(err);
+            }
 
             is_valid = true;
             ALOGI("Loaded {} buttons, {} pins",
@@ -95,6 +111,12 @@ public:
                     toml::find<std::string>(v,"antctrl"),
                     toml::find<std::string>(v,"sch")
                 );
+                if (pin.ioType == INP){
+                    parseInputFilter(v, pin);
+                }
+                // range check, before the pin is used as a bit number
+                int port, bit;
+                getPinPort(pin, &port, &bit);
                 pins.push_back(pin);
                 counter++;
             }
@@ -104,39 +126,81 @@ public:
         }
     }
 
+    void parseInputFilter(const toml::value& v, pin_t& pin){
+        int debounceMs = toml::find_or<int>(v, "debounce", 0);
+        pin.assertMs = toml::find_or<int>(v, "debounce_assert", debounceMs);
+        pin.deassertMs = toml::find_or<int>(v, "debounce_deassert", debounceMs);
+
+        const std::string filter = toml::find_or<std::string>(v, "filter", "debounce");
+        if (filter == "integrator"){
+            pin.filterMode = FILTER_INTEGRATOR;
+        } else if (filter == "debounce"){
+            pin.filterMode = FILTER_DEBOUNCE;
+        } else {
+            const std::string err = fmt::format(
+                "unknown filter '{}' for pin {}", filter, pin.name);
+            throw std::runtime_error(err);
+        }
+
+        const int maxMs = INPUT_FILTER_MAX_TICKS * INPUT_FILTER_TICK_MS;
+        if ((pin.assertMs < 0) || (pin.assertMs > maxMs) ||
+            (pin.deassertMs < 0) || (pin.deassertMs > maxMs)){
+            const std::string err = fmt::format(
+                "debounce for pin {} must be within 0-{}ms", pin.name, maxMs);
+            throw std::runtime_error(err);
+        }
+    }
+
     int parseButtons(toml::value& v){
         try {
             const auto _button_groups = toml::find(v, "buttons");
             int counter = 0;
 
+            // toml tables are unordered - keep groups sorted by name
+            std::vector<std::string> groupNames;
             for(const auto& bg : _button_groups.as_table()){
-                button_groups[bg.first] = {};
-                for(const auto& b : bg.second.as_array()){
+                groupNames.push_back(bg.first);
+            }
+            std::sort(groupNames.begin(), groupNames.end());
+
+            if (button_groups.size() + groupNames.size() > MAX_BUTTON_GROUPS){
+                const std::string err = fmt::format(
+                    "too many button groups, max is {}", MAX_BUTTON_GROUPS);
+                throw std::runtime_error(err);
+            }
+
+            for(const auto& groupName : groupNames){
+                buttonGroup_t bGroup;
+                bGroup.name = groupName;
+                uint16_t groupId = button_groups.size();
+
+                for(const auto& b : toml::find(_button_groups, groupName).as_array()){
                     button_t button(
                         toml::find<std::string>(b,"name"),
-                        toml::find<std::vector<std::string>>(b,"pins")
+                        buttons.size(),
+                        groupId
                     );
-                    if (b.contains("disable_on_low")){
-                        const std::vector<std::string>& condPinNames = 
-                            toml::find<std::vector<std::string>>(b,"disable_on_low");
-
-                        for (auto& p : condPinNames){
-                            pin_t& pin = getPinByName(p);
-                            pin.setGuard(button.name, false);
-                        }
+                    for (auto& p : toml::find<std::vector<std::string>>(b,"pins")){
+                        addUniqueId(button.pinIds, getPinId(p));
                     }
-                    if (b.contains("disable_on_high")){
-                        const std::vector<std::string>& condPinNames = 
-                            toml::find<std::vector<std::string>>(b,"disable_on_high");
-
-                        for (auto& p : condPinNames){
-                            pin_t& pin = getPinByName(p);
-                            pin.setGuard(button.name, true);
+                    parseGuards(b, "disable_on_low", button.id, false);
+                    parseGuards(b, "disable_on_high", button.id, true);
+
+                    for (auto pinId: button.pinIds){
+                        const pin_t& pin = pins[pinId];
+                        if (!isOutputType(pin.ioType)){
+                            const std::string err = fmt::format(
+                                "pin {} of button {} is not an output", pin.name, button.name);
+                            throw std::runtime_error(err);
                         }
+                        compileOutputMask(button.outputs, pin, true);
+                        compileOutputMask(bGroup.reset, pin, false);
                     }
+                    bGroup.buttonIds.push_back(button.id);
+                    buttons.push_back(button);
                     counter++;
-                    button_groups[bg.first].buttons.push_back(button);
                 }
+                button_groups.push_back(bGroup);
             }
             return counter;
         } catch (std::out_of_range& e){
@@ -144,102 +208,274 @@ public:
         }
     }
 
-    pin_t& getPinByName(const std::string& name, bool assertDuplicates = false){
-        std::vector<pin_t> found_pins;
-        for(auto& p : pins){
-            // ALOGD(p.to_string());
-            if ((p.name == name) || (p.sch == name)){
-                if (!assertDuplicates){
-                    return p;
-                }
-                found_pins.push_back(p);
-            }
+    void parseGuards(const toml::value& b, const char* key, uint16_t buttonId, bool onHigh){
+        if (!b.contains(key)){
+            return;
         }
+        const std::vector<std::string>& condPinNames =
+            toml::find<std::vector<std::string>>(b, key);
 
-        if (found_pins.size() == 1){
-            return found_pins[0];
-        } else if (found_pins.size() > 1){
-            const std::string err = fmt::format(
-                "pin {} is not unique!", name);
-            throw std::runtime_error(err);
-        } else {
+        for (auto& p : condPinNames){
+            pins[getPinId(p)].setGuard(buttonId, onHigh);
+        }
+    }
+
+    static void addUniqueId(std::vector<uint16_t>& ids, uint16_t id){
+        if (std::find(ids.begin(), ids.end(), id) == ids.end()){
+            ids.push_back(id);
+        }
+    }
+
+    // pins may be referred to by either name or schematic name
+    void indexPins(){
+        pinIndex.clear();
+        for (int i = 0; i < pins.size(); i++){
+            pinIndex.add(pins[i].name, i);
+            pinIndex.add(pins[i].sch, i);
+        }
+        pinIndex.build();
+    }
+
+    void indexButtons(){
+        buttonIndex.clear();
+        for (auto& b: buttons){
+            buttonIndex.add(b.name, b.id);
+        }
+        buttonIndex.build();
+
+        groupIndex.clear();
+        for (int i = 0; i < button_groups.size(); i++){
+            groupIndex.add(button_groups[i].name, i);
+        }
+        groupIndex.build();
+    }
+
+    uint16_t getPinId(const std::string& name){
+        int id = pinIndex.find(name);
+        if (id < 0){
             const std::string err = fmt::format(
             "pin '{}' not found!", name);
             throw std::runtime_error(err);
         }
+        return id;
     }
 
+    // Input pin guards are resolved into per-bit lists of button ids,
+    // so an input change does not need any name lookups. Every button
+    // also gets a mask of all its guards, checked before activation.
+    void compileGuards(){
+        for (auto& b: buttons){
+            b.guardMask = {};
+        }
 
-    std::vector<std::tuple<pin_t&, pinGuard_t&>> gatherGuards( bool inputOnly = false, 
-        std::string forPinName = "", std::string forButtonName = ""
-    ){
-        std::vector<std::tuple<pin_t&, pinGuard_t&>> guards;
-
+        guardedInputs = 0;
+        for (auto& g: inputGuards){
+            g.clear();
+        }
         for (auto& pin: pins){
-            if (inputOnly && (pin.ioType != INP)){
-                continue;
+            for (auto& guard: pin.pinGuards){
+                compileGuardMask(pin, guard);
             }
-            if ((forPinName != "") && (pin.name != forPinName)){
+            if ((pin.ioType != INP) || (pin.pinGuards.size() == 0)){
                 continue;
             }
             for (auto& guard: pin.pinGuards){
-                if ((forButtonName != "") && (guard.guardedButton != forButtonName)){
-                    continue;
-                }
-                guards.push_back(std::forward_as_tuple(pin, guard));
-                ALOGT("push pin |{}| guards button |{}|", pin.name, guard.guardedButton);
+                inputGuard_t inputGuard;
+                inputGuard.buttonId = guard.buttonId;
+                inputGuard.onHigh = guard.onHigh;
+                inputGuards[pin.ioNum].push_back(inputGuard);
             }
+            guardedInputs |= (uint16_t)0x01 << pin.ioNum;
         }
-        ALOGT("gathered {} guards", guards.size());
-        return guards;
+        ALOGD("input guards compiled, guarded inputs: {:#06x}", guardedInputs);
     }
 
-    button_t& getButtonByName(const std::string& name){
-        for(auto& bg : button_groups){
-            for(auto& b : bg.second.buttons){
-                if (b.name == name){
-                    return b;
-                }
+    // expander register (or GUARD_PORT_INP) and bit of a pin
+    void getPinPort(const pin_t& pin, int* port, int* bit){
+        int width = INPUT_GUARD_BITS;
+        *port = GUARD_PORT_INP;
+        *bit = pin.ioNum;
+        if (isOutputType(pin.ioType)){
+            const outputGroupDesc_t& desc = board::OUTPUTS[pin.ioType];
+            *port = desc.exp;
+            *bit += desc.offs;
+            width = desc.width;
+        }
+        if ((pin.ioNum < 0) || (pin.ioNum >= width)){
+            const std::string err = fmt::format(
+                "pin {} out of range", pin.name);
+            throw std::runtime_error(err);
+        }
+    }
+
+    void compileOutputMask(outputTransaction_t& tx, const pin_t& pin, bool val){
+        int port, bit;
+        getPinPort(pin, &port, &bit);
+
+        tx.mask[port] |= (uint16_t)0x01 << bit;
+        if (val){
+            tx.bits[port] |= (uint16_t)0x01 << bit;
+        }
+    }
+
+    void compileGuardMask(const pin_t& pin, const pinGuard_t& guard){
+        int port, bit;
+        getPinPort(pin, &port, &bit);
+
+        guardMask_t& mask = buttons[guard.buttonId].guardMask;
+        if (guard.onHigh){
+            mask.high[port] |= (uint16_t)0x01 << bit;
+        } else {
+            mask.low[port] |= (uint16_t)0x01 << bit;
+        }
+    }
+
+    // serialized length of a JSON string, quotes and escapes included
+    static size_t jsonStringLength(const std::string& str){
+        StaticJsonDocument<16> doc;
+        doc.set(str.c_str());
+        return measureJson(doc);
+    }
+
+    // Upper bound of the serialized state (/api/INF) - every group with
+    // its longest button active. Delta events are a subset of it.
+    size_t stateJsonLength() const {
+        size_t len = STATE_JSON_BASE_LENGTH;
+        for (auto& group: button_groups){
+            size_t longest = jsonStringLength("OFF");
+            for (auto buttonId: group.buttonIds){
+                longest = std::max(longest, jsonStringLength(buttons[buttonId].name));
+            }
+            // "group":"button",
+            len += jsonStringLength(group.name) + longest + 2;
+        }
+        return len;
+    }
+
+    // API boundary lookups, return -1 if not found
+    int findGroup(std::string_view name) const {
+        return groupIndex.find(name);
+    }
+
+    int findButton(int groupId, std::string_view name) const {
+        int id = buttonIndex.find(name);
+        if ((id >= 0) && (buttons[id].groupId == groupId)){
+            return id;
+        }
+        // button names are only unique within a group
+        for (auto buttonId: button_groups[groupId].buttonIds){
+            if (buttons[buttonId].name == name){
+                return buttonId;
             }
         }
-        const std::string err = fmt::format(
-            "button '{}' not found!", name);
-        throw std::runtime_error(err);
+        return -1;
     }
 
-    void printConfig(){
+    void printConfig() const {
         if (!is_valid){
             ALOGE("Invalid config!");
         }
         ALOGD_RAW("== button map ==")
         for (auto& b_group : button_groups) {
-            ALOGD_RAW("group {}:", b_group.first)
-            for(auto& b : b_group.second.buttons){
-                ALOGD_RAW("\t{}", b.to_string())
+            ALOGD_RAW("group {}:", b_group.name)
+            for(auto buttonId : b_group.buttonIds){
+                const button_t& b = buttons[buttonId];
+                std::vector<std::string> pinNames;
+                for (auto pinId: b.pinIds){
+                    pinNames.push_back(pins[pinId].name);
+                }
+                ALOGD_RAW("\t{}: [{}]", b.name, fmt::join(pinNames, " "))
             }
         }
         ALOGD_RAW("== pins ==")
         for(auto& p : pins){
-            ALOGD_RAW("\t{}", p.to_string())
+            std::string guards;
+            for (auto& g : p.pinGuards){
+                guards += fmt::format(" ('{}'@{})",
+                    buttons[g.buttonId].name, g.onHigh ? "high" : "low");
+            }
+            ALOGD_RAW("\t{}{}", p.to_string(), guards)
         }
     }
 
-    void trySpawnLoaderTask(const char* config_filename){
-        bool taskCreated = xTaskCreate( configLoaderTask, "toml task",
-            100*1000, (void*) config_filename, 6, NULL );
-        if (taskCreated != pdPASS) {
-            ALOGE("Failed to create TOML task");
-        }
-    }
+    // TOML is parsed only if the compiled config in flash was built
+    // from other sources, see configImage.h
+    bool loadCompiledConfig(const char* name);
+    void storeCompiledConfig(uint32_t sourceHash) const;
+
+    // compiled-in buttons_simple.conf, see builtinConfig.h
+    void loadBuiltinConfig();
 
     bool is_valid = false;
+    // set by ConfigStore_, bumped on every published config
+    uint32_t generation = 0;
 
-    std::map<std::string, buttonGroup_t> button_groups;
-    // std::map<std::string, std::vector<const pin_t*>> pins_by_group;
+    // indexed by IDs, assigned in the order of loading
+    std::vector<buttonGroup_t> button_groups;
+    std::vector<button_t> buttons;
     std::vector<pin_t> pins;
     std::string config_filename = "undefined";
+
+    nameIndex_t pinIndex;
+    nameIndex_t buttonIndex;
+    nameIndex_t groupIndex;
+
+    // compiled by compileGuards()
+    std::vector<inputGuard_t> inputGuards[INPUT_GUARD_BITS];
+    uint16_t guardedInputs = 0;
+};
+
+typedef std::shared_ptr<const Config_> configSnapshot_t;
+
+// called with a loaded config, which it must pass to ConfigStore_::swap()
+typedef void (*configPublishFn_t)(std::shared_ptr<Config_> next, void* arg);
+
+// The config is published as immutable snapshots (RCU style). A reload
+// builds a complete new Config_ in the background and swaps it in with
+// a single pointer store. Readers keep the snapshot they got for as
+// long as they hold it, the old one is freed once the last one is done.
+class ConfigStore_ {
+public:
+    ConfigStore_() = default;
+
+    static ConfigStore_ &getInstance(){
+        static ConfigStore_ instance;
+        return instance;
+    }
+
+    // current snapshot, never NULL - for tasks other than the controller
+    configSnapshot_t get() const {
+        return std::atomic_load(&current);
+    }
+
+    // Controller task only, without reference counting. The swap is
+    // done by a controller job, so the config doesn't change during one.
+    const Config_& active() const {
+        return *activeConfig;
+    }
+
+    // compiled config if it's valid, otherwise TOML on a loader task
+    void load(const char* name);
+    // compiled-in buttons_simple.conf, see builtinConfig.h
+    void loadBuiltin();
+
+    // Hands a loaded config to the publish hook (IoController, which
+    // swaps it on the controller task and remaps active buttons), or
+    // swaps it right away if there's none.
+    void publish(std::shared_ptr<Config_> next);
+    void attachPublishHook(configPublishFn_t fn, void* arg);
+
+    // bumps the generation and publishes next, returns the old snapshot
+    configSnapshot_t swap(std::shared_ptr<Config_> next);
+
+private:
+    configSnapshot_t current = std::make_shared<const Config_>();
+    const Config_* activeConfig = current.get();
+
+    configPublishFn_t publishHook = NULL;
+    void* publishHookArg = NULL;
 };
 
-extern Config_ &Config;
+extern ConfigStore_ &ConfigStore;
 
 #endif //CONFIG_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,349 @@
+#include "configImage.h"
+
+#include <string.h>
+
+#include "configHandler.h"
+
+#ifdef ESP32
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+#endif
+
+namespace {
+
+// Appends records and their data, keeping arrays 4-byte aligned.
+// Records are written with memcpy, as reserving more space may
+// move the buffer.
+class ImageWriter {
+public:
+    explicit ImageWriter(std::vector<uint8_t>& image) : image(image) {}
+
+    uint32_t reserve(size_t len){
+        align();
+        uint32_t offset = image.size();
+        image.resize(offset + len, 0x00);
+        return offset;
+    }
+
+    template <typename T>
+    void put(uint32_t offset, const T& record){
+        memcpy(image.data() + offset, &record, sizeof(T));
+    }
+
+    uint32_t addString(const std::string& str){
+        uint32_t offset = image.size();
+        image.insert(image.end(), str.begin(), str.end());
+        image.push_back(0x00);
+        return offset;
+    }
+
+    uint32_t addIds(const std::vector<uint16_t>& ids){
+        uint32_t offset = reserve(ids.size() * sizeof(uint16_t));
+        if (ids.size() > 0){
+            memcpy(image.data() + offset, ids.data(), ids.size() * sizeof(uint16_t));
+        }
+        return offset;
+    }
+
+private:
+    void align(){
+        while (image.size() % 4 != 0){
+            image.push_back(0x00);
+        }
+    }
+
+    std::vector<uint8_t>& image;
+};
+
+// Read-side bounds checks
+class ImageReader {
+public:
+    ImageReader(const uint8_t* image, uint32_t size) : image(image), size(size) {}
+
+    bool hasArray(uint32_t offset, uint32_t count, size_t itemSize) const {
+        return (offset % 4 == 0) && (offset <= size) &&
+            ((uint64_t)count * itemSize <= size - offset);
+    }
+
+    bool hasString(uint32_t offset) const {
+        return (offset < size) && (memchr(image + offset, 0x00, size - offset) != NULL);
+    }
+
+    bool hasIds(uint32_t offset, uint16_t count, uint16_t limit) const {
+        if (!hasArray(offset, count, sizeof(uint16_t))){
+            return false;
+        }
+        const uint16_t* ids = at<uint16_t>(offset);
+        for (int i = 0; i < count; i++){
+            if (ids[i] >= limit){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename T>
+    const T* at(uint32_t offset) const {
+        return (const T*)(image + offset);
+    }
+
+    const char* str(uint32_t offset) const {
+        return (const char*)(image + offset);
+    }
+
+private:
+    const uint8_t* image;
+    uint32_t size;
+};
+
+}
+
+void configImage::build(const Config_& config, uint32_t sourceHash, std::vector<uint8_t>& image){
+    image.clear();
+    ImageWriter w(image);
+
+    cfgImageHeader_t header = {};
+    header.magic = CONFIG_IMAGE_MAGIC;
+    header.version = CONFIG_IMAGE_VERSION;
+    header.pinCount = config.pins.size();
+    header.buttonCount = config.buttons.size();
+    header.groupCount = config.button_groups.size();
+    header.sourceHash = sourceHash;
+
+    w.reserve(sizeof(header));
+    header.pins = w.reserve(header.pinCount * sizeof(cfgImagePin_t));
+    header.buttons = w.reserve(header.buttonCount * sizeof(cfgImageButton_t));
+    header.groups = w.reserve(header.groupCount * sizeof(cfgImageGroup_t));
+
+    for (int i = 0; i < header.pinCount; i++){
+        const pin_t& pin = config.pins[i];
+        cfgImagePin_t record = {};
+        record.ioType = pin.ioType;
+        record.ioNum = pin.ioNum;
+        record.filterMode = pin.filterMode;
+        record.assertMs = pin.assertMs;
+        record.deassertMs = pin.deassertMs;
+        record.guardCount = pin.pinGuards.size();
+        record.guards = w.reserve(record.guardCount * sizeof(cfgImageGuard_t));
+        for (int g = 0; g < record.guardCount; g++){
+            cfgImageGuard_t guard = {};
+            guard.buttonId = pin.pinGuards[g].buttonId;
+            guard.onHigh = pin.pinGuards[g].onHigh;
+            w.put(record.guards + g * sizeof(cfgImageGuard_t), guard);
+        }
+        record.name = w.addString(pin.name);
+        record.sch = w.addString(pin.sch);
+        w.put(header.pins + i * sizeof(cfgImagePin_t), record);
+    }
+
+    for (int i = 0; i < header.buttonCount; i++){
+        const button_t& button = config.buttons[i];
+        cfgImageButton_t record = {};
+        record.groupId = button.groupId;
+        record.outputs = button.outputs;
+        record.pinCount = button.pinIds.size();
+        record.pinIds = w.addIds(button.pinIds);
+        record.name = w.addString(button.name);
+        w.put(header.buttons + i * sizeof(cfgImageButton_t), record);
+    }
+
+    for (int i = 0; i < header.groupCount; i++){
+        const buttonGroup_t& group = config.button_groups[i];
+        cfgImageGroup_t record = {};
+        record.reset = group.reset;
+        record.buttonCount = group.buttonIds.size();
+        record.buttonIds = w.addIds(group.buttonIds);
+        record.name = w.addString(group.name);
+        w.put(header.groups + i * sizeof(cfgImageGroup_t), record);
+    }
+
+    header.filename = w.addString(config.config_filename);
+    header.size = image.size();
+    header.bodyHash = configHash(CONFIG_HASH_SEED,
+        image.data() + sizeof(header), image.size() - sizeof(header));
+    w.put(0, header);
+}
+
+const char* configImage::validate(const uint8_t* image, size_t maxSize, uint32_t sourceHash){
+    if (maxSize < sizeof(cfgImageHeader_t)){
+        return "too small";
+    }
+    const cfgImageHeader_t* h = (const cfgImageHeader_t*)image;
+    if (h->magic != CONFIG_IMAGE_MAGIC){
+        return "no image";
+    }
+    if (h->version != CONFIG_IMAGE_VERSION){
+        return "other version";
+    }
+    if (h->sourceHash != sourceHash){
+        return "config changed";
+    }
+    if ((h->size < sizeof(cfgImageHeader_t)) || (h->size > maxSize)){
+        return "invalid size";
+    }
+    uint32_t bodyHash = configHash(CONFIG_HASH_SEED,
+        image + sizeof(cfgImageHeader_t), h->size - sizeof(cfgImageHeader_t));
+    if (bodyHash != h->bodyHash){
+        return "corrupted";
+    }
+
+    ImageReader r(image, h->size);
+    if (!r.hasArray(h->pins, h->pinCount, sizeof(cfgImagePin_t)) ||
+        !r.hasArray(h->buttons, h->buttonCount, sizeof(cfgImageButton_t)) ||
+        !r.hasArray(h->groups, h->groupCount, sizeof(cfgImageGroup_t)) ||
+        !r.hasString(h->filename) ||
+        (h->groupCount > MAX_BUTTON_GROUPS)){
+        return "invalid header";
+    }
+
+    const cfgImagePin_t* pins = r.at<cfgImagePin_t>(h->pins);
+    for (int i = 0; i < h->pinCount; i++){
+        const cfgImagePin_t& pin = pins[i];
+        if (!r.hasString(pin.name) || !r.hasString(pin.sch) ||
+            !r.hasArray(pin.guards, pin.guardCount, sizeof(cfgImageGuard_t)) ||
+            (pin.ioType >= OUT_TYPE_COUNT) || (pin.ioNum < 0)){
+            return "invalid pin";
+        }
+        // same limit as Config_::getPinPort()
+        antControllerIoType_t ioType = (antControllerIoType_t)pin.ioType;
+        int width = isOutputType(ioType) ? board::OUTPUTS[ioType].width : INPUT_GUARD_BITS;
+        if (pin.ioNum >= width){
+            return "invalid pin";
+        }
+        const cfgImageGuard_t* guards = r.at<cfgImageGuard_t>(pin.guards);
+        for (int g = 0; g < pin.guardCount; g++){
+            if (guards[g].buttonId >= h->buttonCount){
+                return "invalid pin";
+            }
+        }
+    }
+
+    const cfgImageButton_t* buttons = r.at<cfgImageButton_t>(h->buttons);
+    for (int i = 0; i < h->buttonCount; i++){
+        const cfgImageButton_t& button = buttons[i];
+        if (!r.hasString(button.name) ||
+            !r.hasIds(button.pinIds, button.pinCount, h->pinCount) ||
+            (button.groupId >= h->groupCount)){
+            return "invalid button";
+        }
+    }
+
+    const cfgImageGroup_t* groups = r.at<cfgImageGroup_t>(h->groups);
+    for (int i = 0; i < h->groupCount; i++){
+        const cfgImageGroup_t& group = groups[i];
+        if (!r.hasString(group.name) ||
+            !r.hasIds(group.buttonIds, group.buttonCount, h->buttonCount)){
+            return "invalid group";
+        }
+    }
+    return NULL;
+}
+
+void configImage::decode(const uint8_t* image, Config_& config){
+    const cfgImageHeader_t* h = (const cfgImageHeader_t*)image;
+    ImageReader r(image, h->size);
+
+    // group state is mutable, and names are used as std::string by
+    // the rest of the firmware - so records are read in place, but
+    // their contents are copied
+    config.pins.reserve(h->pinCount);
+    const cfgImagePin_t* pins = r.at<cfgImagePin_t>(h->pins);
+    for (int i = 0; i < h->pinCount; i++){
+        const cfgImagePin_t& record = pins[i];
+        pin_t pin(r.str(record.name), r.str(record.sch),
+            (antControllerIoType_t)record.ioType, record.ioNum);
+        pin.filterMode = (inputFilterMode_t)record.filterMode;
+        pin.assertMs = record.assertMs;
+        pin.deassertMs = record.deassertMs;
+        const cfgImageGuard_t* guards = r.at<cfgImageGuard_t>(record.guards);
+        pin.pinGuards.reserve(record.guardCount);
+        for (int g = 0; g < record.guardCount; g++){
+            pin.setGuard(guards[g].buttonId, guards[g].onHigh);
+        }
+        config.pins.push_back(std::move(pin));
+    }
+
+    config.buttons.reserve(h->buttonCount);
+    const cfgImageButton_t* buttons = r.at<cfgImageButton_t>(h->buttons);
+    for (int i = 0; i < h->buttonCount; i++){
+        const cfgImageButton_t& record = buttons[i];
+        button_t button(r.str(record.name), i, record.groupId);
+        const uint16_t* pinIds = r.at<uint16_t>(record.pinIds);
+        button.pinIds.assign(pinIds, pinIds + record.pinCount);
+        button.outputs = record.outputs;
+        config.buttons.push_back(std::move(button));
+    }
+
+    config.button_groups.reserve(h->groupCount);
+    const cfgImageGroup_t* groups = r.at<cfgImageGroup_t>(h->groups);
+    for (int i = 0; i < h->groupCount; i++){
+        const cfgImageGroup_t& record = groups[i];
+        buttonGroup_t group;
+        group.name = r.str(record.name);
+        const uint16_t* buttonIds = r.at<uint16_t>(record.buttonIds);
+        group.buttonIds.assign(buttonIds, buttonIds + record.buttonCount);
+        group.reset = record.reset;
+        config.button_groups.push_back(std::move(group));
+    }
+
+    config.config_filename = r.str(h->filename);
+    config.indexPins();
+    config.indexButtons();
+    config.compileGuards();
+    config.is_valid = true;
+}
+
+#ifdef ESP32
+
+static const esp_partition_t* findPartition(){
+    const esp_partition_t* partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, CONFIG_PARTITION_LABEL);
+    if (partition == NULL){
+        ALOGW("No '{}' partition, config is parsed on every boot", CONFIG_PARTITION_LABEL);
+    }
+    return partition;
+}
+
+bool ConfigImageStore::load(uint32_t sourceHash, Config_& config){
+    const esp_partition_t* partition = findPartition();
+    if (partition == NULL){
+        return false;
+    }
+    const void* mapped;
+    spi_flash_mmap_handle_t handle;
+    if (esp_partition_mmap(partition, 0, partition->size,
+            SPI_FLASH_MMAP_DATA, &mapped, &handle) != ESP_OK){
+        ALOGE("Failed to map the config partition");
+        return false;
+    }
+    const char* error = configImage::validate((const uint8_t*)mapped, partition->size, sourceHash);
+    if (error == NULL){
+        configImage::decode((const uint8_t*)mapped, config);
+    } else {
+        ALOGD("Compiled config not used: {}", error);
+    }
+    spi_flash_munmap(handle);
+    return error == NULL;
+}
+
+bool ConfigImageStore::store(const std::vector<uint8_t>& image){
+    const esp_partition_t* partition = findPartition();
+    if (partition == NULL){
+        return false;
+    }
+    if (image.size() > partition->size){
+        ALOGE("Compiled config too large ({}B)", image.size());
+        return false;
+    }
+    // an interrupted write leaves an image with a wrong body hash
+    size_t eraseSize = (image.size() + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    if ((esp_partition_erase_range(partition, 0, eraseSize) != ESP_OK) ||
+        (esp_partition_write(partition, 0, image.data(), image.size()) != ESP_OK)){
+        ALOGE("Failed to write the config partition");
+        return false;
+    }
+    ALOGD("Compiled config stored ({}B)", image.size());
+    return true;
+}
+
+#endif // ESP32
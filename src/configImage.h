@@ -0,0 +1,114 @@
+#ifndef CONFIG_IMAGE_H
+#define CONFIG_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "ioControllerTypes.h"
+
+// Compiled config - pins, buttons and groups as flat records, with
+// offsets instead of pointers, so it can be read in place from a
+// memory-mapped flash partition. Built after a successful TOML parse,
+// and used on the following boots for as long as the hash of the
+// TOML sources stays the same.
+//
+// All offsets are from the start of the image, strings are
+// nul-terminated, arrays are 4-byte aligned.
+
+const uint32_t CONFIG_IMAGE_MAGIC = 0x47464341; // "ACFG"
+// bumped whenever the layout below changes
+const uint16_t CONFIG_IMAGE_VERSION = 1;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t pinCount;
+    uint16_t buttonCount;
+    uint16_t groupCount;
+    uint32_t size;          // whole image, header included
+    uint32_t sourceHash;    // see configSourceHash()
+    uint32_t bodyHash;      // of everything after the header
+    uint32_t pins;          // cfgImagePin_t[pinCount]
+    uint32_t buttons;       // cfgImageButton_t[buttonCount]
+    uint32_t groups;        // cfgImageGroup_t[groupCount]
+    uint32_t filename;      // Config_::config_filename
+} cfgImageHeader_t;
+
+typedef struct {
+    uint16_t buttonId;
+    uint8_t onHigh;
+    uint8_t reserved;
+} cfgImageGuard_t;
+
+typedef struct {
+    uint32_t name;
+    uint32_t sch;
+    uint32_t guards;        // cfgImageGuard_t[guardCount]
+    uint16_t guardCount;
+    uint8_t ioType;
+    uint8_t filterMode;
+    int16_t ioNum;
+    uint16_t assertMs;
+    uint16_t deassertMs;
+    uint16_t reserved;
+} cfgImagePin_t;
+
+typedef struct {
+    uint32_t name;
+    uint32_t pinIds;        // uint16_t[pinCount]
+    uint16_t pinCount;
+    uint16_t groupId;
+    outputTransaction_t outputs;
+} cfgImageButton_t;
+
+typedef struct {
+    uint32_t name;
+    uint32_t buttonIds;     // uint16_t[buttonCount]
+    uint16_t buttonCount;
+    uint16_t reserved;
+    outputTransaction_t reset;
+} cfgImageGroup_t;
+
+// FNV-1a, fed incrementally - start with CONFIG_HASH_SEED
+const uint32_t CONFIG_HASH_SEED = 0x811c9dc5;
+
+inline uint32_t configHash(uint32_t hash, const void* data, size_t len){
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < len; i++){
+        hash = (hash ^ bytes[i]) * 0x01000193;
+    }
+    return hash;
+}
+
+class Config_;
+
+// image <-> Config_, plain code shared with the host-side tests
+namespace configImage {
+    // serializes a parsed config into image
+    void build(const Config_& config, uint32_t sourceHash, std::vector<uint8_t>& image);
+
+    // checks the header, hashes and bounds of every record - returns
+    // NULL if valid, or the reason it's not
+    const char* validate(const uint8_t* image, size_t maxSize, uint32_t sourceHash);
+
+    // fills a cleared config from a validated image
+    void decode(const uint8_t* image, Config_& config);
+}
+
+#ifdef ESP32
+
+// "config" data partition, see partitions.csv
+const char CONFIG_PARTITION_LABEL[] = "config";
+
+class ConfigImageStore {
+public:
+    // maps the partition and decodes the image, if it's valid and
+    // was built from sourceHash
+    static bool load(uint32_t sourceHash, Config_& config);
+    static bool store(const std::vector<uint8_t>& image);
+};
+
+#endif // ESP32
+
+#endif // CONFIG_IMAGE_H
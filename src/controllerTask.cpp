@@ -0,0 +1,88 @@
+#include "controllerTask.h"
+#include "alfalog.h"
+
+ControllerTask_ &ControllerTask = ControllerTask.getInstance();
+
+static const char* ctrlLaneNames[CTRL_LANE_COUNT] = {
+    "panic", "guard", "api", "housekeeping"
+};
+
+ControllerTask_::ControllerTask_(): LaneWorker("controller", ctrlLaneNames, CTRL_LANE_COUNT) {}
+
+void ControllerTask_::begin(){
+    for (auto& call: calls){
+        call.done = xSemaphoreCreateBinaryStatic(&call.doneBuffer);
+    }
+    // above the input sampler, so input changes are applied right away,
+    // below the I2C bus task, which it waits for
+    if (!start(6000, 21, tskNO_AFFINITY)){
+        ALOGE("Failed to create controller task, jobs run in caller context!");
+    }
+}
+
+ctrlCall_t* ControllerTask_::acquireCall(){
+    for (auto& call: calls){
+        uint8_t expected = CTRL_CALL_FREE;
+        if (call.state.compare_exchange_strong(expected, CTRL_CALL_PENDING)){
+            // may be left given by a call that wasn't waited for
+            xSemaphoreTake(call.done, 0);
+            call.code = 200;
+            call.len = 0;
+            return &call;
+        }
+    }
+    return NULL;
+}
+
+// post() and run() return the job's result, when it runs in the
+// caller's context - a job may complete its call and still return
+// false, so a call is only failed here if nobody completed it
+bool ControllerTask_::postCall(ctrlLane_t lane, ctrlJobFn_t fn, ctrlCall_t* call){
+    if (post(lane, fn, call) || (call->state.load() != CTRL_CALL_PENDING)){
+        return true;
+    }
+    call->code = 503;
+    call->len = 0;
+    completeCall(call);
+    return false;
+}
+
+bool ControllerTask_::runCall(ctrlLane_t lane, ctrlJobFn_t fn, ctrlCall_t* call){
+    if (run(lane, fn, call) || (call->state.load() != CTRL_CALL_PENDING)){
+        return true;
+    }
+    call->code = 503;
+    call->len = 0;
+    completeCall(call);
+    return false;
+}
+
+void ControllerTask_::completeCall(ctrlCall_t* call){
+    uint8_t expected = CTRL_CALL_PENDING;
+    if (call->state.compare_exchange_strong(expected, CTRL_CALL_DONE)){
+        xSemaphoreGive(call->done);
+        return;
+    }
+    // nobody is waiting for the reply anymore. A call completed twice
+    // is left alone - its reply may still be read.
+    expected = CTRL_CALL_ABANDONED;
+    call->state.compare_exchange_strong(expected, CTRL_CALL_FREE);
+}
+
+bool ControllerTask_::waitCall(ctrlCall_t* call, int timeoutMs){
+    return xSemaphoreTake(call->done, timeoutMs / portTICK_PERIOD_MS) == pdTRUE;
+}
+
+bool ControllerTask_::isCallDone(ctrlCall_t* call){
+    return call->state.load() == CTRL_CALL_DONE;
+}
+
+void ControllerTask_::releaseCall(ctrlCall_t* call){
+    uint8_t expected = CTRL_CALL_PENDING;
+    if (call->state.compare_exchange_strong(expected, CTRL_CALL_ABANDONED)){
+        return;
+    }
+    // already completed
+    expected = CTRL_CALL_DONE;
+    call->state.compare_exchange_strong(expected, CTRL_CALL_FREE);
+}
@@ -0,0 +1,81 @@
+#ifndef CONTROLLER_TASK_H
+#define CONTROLLER_TASK_H
+
+#include <atomic>
+#include "laneWorker.h"
+#include "jsonPool.h"
+
+// Priority lanes of the controller task - a pending job from a lower
+// lane is only started, when all the higher lanes are empty.
+typedef enum {
+    CTRL_LANE_PANIC = 0,    // lock / panic input changes
+    CTRL_LANE_GUARD,        // other input changes, pin guards
+    CTRL_LANE_API,          // HTTP, serial
+    CTRL_LANE_HOUSEKEEPING, // state events
+    CTRL_LANE_COUNT
+} ctrlLane_t;
+
+static_assert(CTRL_LANE_COUNT <= LANE_WORKER_MAX_LANES, "Too many controller lanes");
+
+typedef laneJobFn_t ctrlJobFn_t;
+
+// Calls from the async_tcp task, completed by the controller task.
+// buf holds the request (path, batch body, binary frame) until the
+// call is executed, and the serialized reply afterwards.
+const int CTRL_CALL_COUNT = 4;
+const size_t CTRL_CALL_BUFFER = API_JSON_CAPACITY;
+// how long the HTTP handler waits for the call, before leaving the
+// reply to the server's poll - above the panic reaction bound, so a
+// call held up by a panic still makes it
+const int CTRL_CALL_WAIT_MS = 50;
+
+typedef enum : uint8_t {
+    CTRL_CALL_FREE = 0,
+    CTRL_CALL_PENDING,      // owned by the request, not completed yet
+    CTRL_CALL_DONE,
+    CTRL_CALL_ABANDONED     // request is gone, freed once completed
+} ctrlCallState_t;
+
+typedef struct {
+    std::atomic<uint8_t> state;
+    SemaphoreHandle_t done;
+    StaticSemaphore_t doneBuffer;
+    int code;
+    size_t len;
+    char buf[CTRL_CALL_BUFFER];
+} ctrlCall_t;
+
+// The only context allowed to touch IoController and ButtonHandler
+// state. Jobs are executed one at a time, in the order of lane priority.
+class ControllerTask_ : public LaneWorker {
+public:
+    ControllerTask_();
+
+    static ControllerTask_ &getInstance(){
+        static ControllerTask_ instance;
+        return instance;
+    }
+
+    void begin();
+
+    // NULL if all the calls are in use
+    ctrlCall_t* acquireCall();
+    // like post() and run(), but the call is completed (with code 503
+    // and no reply) if the lane is full, so it can always be released
+    bool postCall(ctrlLane_t lane, ctrlJobFn_t fn, ctrlCall_t* call);
+    bool runCall(ctrlLane_t lane, ctrlJobFn_t fn, ctrlCall_t* call);
+    // called by the job, once the reply is in the call buffer
+    void completeCall(ctrlCall_t* call);
+    // true if the call completed within timeoutMs
+    bool waitCall(ctrlCall_t* call, int timeoutMs);
+    bool isCallDone(ctrlCall_t* call);
+    // called when the request is gone, whether it was completed or not
+    void releaseCall(ctrlCall_t* call);
+
+private:
+    ctrlCall_t calls[CTRL_CALL_COUNT] = {};
+};
+
+extern ControllerTask_ &ControllerTask;
+
+#endif // CONTROLLER_TASK_H
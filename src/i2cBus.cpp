@@ -0,0 +1,22 @@
+#include "i2cBus.h"
+#include "alfalog.h"
+
+I2cBus_ &I2cBus = I2cBus.getInstance();
+
+static const char* i2cLaneNames[I2C_LANE_COUNT] = {
+    "safety", "api"
+};
+
+I2cBus_::I2cBus_(): LaneWorker("i2c bus", i2cLaneNames, I2C_LANE_COUNT) {}
+
+void I2cBus_::begin(){
+    // Above every task that may enqueue a job, so a safety write starts
+    // as soon as the current job ends. The display is redrawn by the
+    // caller (loop task) - TwoWire holds its lock for a single
+    // transaction, at most a 128 byte display page, so a job waits for
+    // one page transfer at most. Pinned to the caller's core, so the
+    // display only gets the bus while this task waits for a job.
+    if (!start(4000, 22, xPortGetCoreID())){
+        ALOGE("Failed to create I2C bus task, bus access is not arbitrated!");
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include "laneWorker.h"
+
+// Priority lanes of the bus owner task - a pending job from a lower
+// lane is only started, when all the higher lanes are empty.
+typedef enum {
+    I2C_LANE_SAFETY = 0, // panic / pin guards
+    I2C_LANE_API,        // outputs set by user
+    I2C_LANE_COUNT
+} i2cLane_t;
+
+static_assert(I2C_LANE_COUNT <= LANE_WORKER_MAX_LANES, "Too many I2C lanes");
+
+typedef laneJobFn_t i2cJobFn_t;
+
+// The only context allowed to talk to the expanders on the shared
+// TwoWire bus. Jobs are executed one at a time, in the order of lane
+// priority. The OLED display is redrawn by the loop task instead - see
+// begin() for how its transfers interleave with the jobs.
+class I2cBus_ : public LaneWorker {
+public:
+    I2cBus_();
+
+    static I2cBus_ &getInstance(){
+        static I2cBus_ instance;
+        return instance;
+    }
+
+    void begin();
+};
+
+extern I2cBus_ &I2cBus;
+
+#endif // I2C_BUS_H
@@ -0,0 +1,85 @@
+#include "inputCapture.h"
+#include "alfalog.h"
+
+void InputCapture::begin(const std::vector<uint8_t>* pins, TaskHandle_t consumerTask){
+    this->consumerTask = consumerTask;
+
+    if (pins->size() > INPUT_CAPTURE_MAX_PINS){
+        ALOGE("Too many inputs for edge capture: {}", pins->size());
+        return;
+    }
+    for (int i = 0; i < pins->size(); i++){
+        isrCtx[i].self = this;
+        isrCtx[i].input = i;
+        isrCtx[i].gpio = (*pins)[i];
+        attachInterruptArg((*pins)[i], onEdgeIsr, &isrCtx[i], CHANGE);
+    }
+    ALOGD("Edge capture enabled on {} inputs", pins->size());
+}
+
+void IRAM_ATTR InputCapture::onEdgeIsr(void* arg){
+    inputIsrCtx_t* ctx = (inputIsrCtx_t*)arg;
+    uint32_t timestampUs = micros();
+
+    ctx->self->push(ctx->input, digitalRead(ctx->gpio), timestampUs);
+
+    BaseType_t higherPrioWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(ctx->self->consumerTask, &higherPrioWoken);
+    if (higherPrioWoken){
+        portYIELD_FROM_ISR();
+    }
+}
+
+void IRAM_ATTR InputCapture::push(uint8_t input, uint8_t level, uint32_t timestampUs){
+    uint32_t h = head.load(std::memory_order_relaxed);
+    uint32_t next = (h + 1) & (INPUT_EDGE_RING_SIZE - 1);
+
+    if (next == tail.load(std::memory_order_acquire)){
+        dropped++;
+        return;
+    }
+    ring[h].input = input;
+    ring[h].level = level;
+    ring[h].timestampUs = timestampUs;
+    head.store(next, std::memory_order_release);
+    captured++;
+}
+
+bool InputCapture::pop(inputEdge_t* edge){
+    uint32_t t = tail.load(std::memory_order_relaxed);
+
+    if (t == head.load(std::memory_order_acquire)){
+        return false;
+    }
+    *edge = ring[t];
+    tail.store((t + 1) & (INPUT_EDGE_RING_SIZE - 1), std::memory_order_release);
+    return true;
+}
+
+void InputCapture::recordLatency(uint32_t latencyUs){
+    if (latencyUs < latencyMinUs){
+        latencyMinUs = latencyUs;
+    }
+    if (latencyUs > latencyMaxUs){
+        latencyMaxUs = latencyUs;
+    }
+    latencyTotalUs += latencyUs;
+    latencyCount++;
+}
+
+void InputCapture::getStats(JsonObject& jsonRef){
+    jsonRef["captured"] = captured;
+    jsonRef["dropped"] = dropped;
+    jsonRef["latencyMinUs"] = (latencyCount > 0) ? latencyMinUs : 0;
+    jsonRef["latencyAvgUs"] = (latencyCount > 0) ? (uint32_t)(latencyTotalUs / latencyCount) : 0;
+    jsonRef["latencyMaxUs"] = latencyMaxUs;
+}
+
+void InputCapture::resetStats(){
+    captured = 0;
+    dropped = 0;
+    latencyMinUs = UINT32_MAX;
+    latencyMaxUs = 0;
+    latencyTotalUs = 0;
+    latencyCount = 0;
+}
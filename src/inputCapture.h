@@ -0,0 +1,64 @@
+#ifndef INPUT_CAPTURE_H
+#define INPUT_CAPTURE_H
+
+#include <atomic>
+#include <vector>
+
+#include <Arduino.h>
+#undef B1
+#include "ArduinoJson.h"
+
+// must be a power of 2
+const int INPUT_EDGE_RING_SIZE = 64;
+const int INPUT_CAPTURE_MAX_PINS = 16;
+
+typedef struct {
+    uint8_t input;  // index in the input pin list
+    uint8_t level;
+    uint32_t timestampUs;
+} inputEdge_t;
+
+class InputCapture;
+
+typedef struct {
+    InputCapture* self;
+    uint8_t input;
+    uint8_t gpio;
+} inputIsrCtx_t;
+
+// GPIO edge interrupts push timestamped records into a lock-free
+// single-producer/single-consumer ring. The consumer task is woken
+// by a task notification and drains the ring with pop().
+class InputCapture {
+public:
+    void begin(const std::vector<uint8_t>* pins, TaskHandle_t consumerTask);
+
+    bool pop(inputEdge_t* edge);
+    void recordLatency(uint32_t latencyUs);
+
+    void getStats(JsonObject& jsonRef);
+    void resetStats();
+
+    uint32_t getDropped() const { return dropped; }
+
+private:
+    static void IRAM_ATTR onEdgeIsr(void* arg);
+    void IRAM_ATTR push(uint8_t input, uint8_t level, uint32_t timestampUs);
+
+    inputEdge_t ring[INPUT_EDGE_RING_SIZE];
+    std::atomic<uint32_t> head{0}; // written by the ISR only
+    std::atomic<uint32_t> tail{0}; // written by the consumer only
+
+    inputIsrCtx_t isrCtx[INPUT_CAPTURE_MAX_PINS];
+    TaskHandle_t consumerTask = NULL;
+
+    volatile uint32_t captured = 0;
+    volatile uint32_t dropped = 0;
+
+    uint32_t latencyMinUs = UINT32_MAX;
+    uint32_t latencyMaxUs = 0;
+    uint64_t latencyTotalUs = 0;
+    uint32_t latencyCount = 0;
+};
+
+#endif // INPUT_CAPTURE_H
@@ -0,0 +1,132 @@
+#ifndef INPUT_FILTER_H
+#define INPUT_FILTER_H
+
+#include <stdint.h>
+
+// counters are INPUT_FILTER_PLANES wide, so max filter time is 63 ticks
+const int INPUT_FILTER_PLANES = 6;
+const int INPUT_FILTER_MAX_TICKS = (1 << INPUT_FILTER_PLANES) - 1;
+const int INPUT_FILTER_TICK_MS = 1;
+
+typedef enum {
+    FILTER_DEBOUNCE = 0, // counter resets when raw level agrees with state
+    FILTER_INTEGRATOR    // counter decrements instead (majority vote)
+} inputFilterMode_t;
+
+// Debounce/glitch filter for the whole INP word.
+//
+// Every input has its own counter, but counters are stored as bit
+// planes (cnt[k] holds bit k of all 16 counters), so a single tick
+// is a handful of bitwise ops, regardless of the number of inputs.
+// A filtered bit flips, when its counter reaches the threshold for
+// the pending direction (assert: low->high, deassert: high->low).
+// Inputs with a zero threshold pass through immediately.
+class InputFilter {
+public:
+    void configure(int input, inputFilterMode_t mode, int assertTicks, int deassertTicks){
+        uint16_t bit = (uint16_t)0x01 << input;
+        for (int k = 0; k < INPUT_FILTER_PLANES; k++){
+            setBit(assertThr[k], bit, (assertTicks >> k) & 0x01);
+            setBit(deassertThr[k], bit, (deassertTicks >> k) & 0x01);
+        }
+        setBit(integratorMask, bit, mode == FILTER_INTEGRATOR);
+    }
+
+    void clearConfig(){
+        for (int k = 0; k < INPUT_FILTER_PLANES; k++){
+            assertThr[k] = 0;
+            deassertThr[k] = 0;
+        }
+        integratorMask = 0;
+    }
+
+    void reset(uint16_t raw){
+        state = raw;
+        for (auto& c: cnt){
+            c = 0;
+        }
+    }
+
+    // called on every raw change - pass-through inputs follow immediately
+    uint16_t sample(uint16_t raw){
+        state ^= (raw ^ state) & passThroughMask();
+        return state;
+    }
+
+    // called every INPUT_FILTER_TICK_MS while isPending()
+    uint16_t tick(uint16_t raw){
+        sample(raw);
+
+        uint16_t diff = raw ^ state;
+        uint16_t inc = diff;
+        uint16_t dec = ~diff & integratorMask & counterNonZero();
+        uint16_t clr = ~diff & ~integratorMask;
+
+        // ripple-carry increment / borrow decrement over the bit planes
+        uint16_t carry = inc;
+        uint16_t borrow = dec;
+        for (int k = 0; k < INPUT_FILTER_PLANES; k++){
+            uint16_t nextCarry = cnt[k] & carry;
+            uint16_t nextBorrow = ~cnt[k] & borrow;
+            cnt[k] ^= carry | borrow;
+            cnt[k] &= ~clr;
+            carry = nextCarry;
+            borrow = nextBorrow;
+        }
+
+        // counters only ever count towards the opposite of the state
+        uint16_t notEqual = 0;
+        for (int k = 0; k < INPUT_FILTER_PLANES; k++){
+            uint16_t thr = (~state & assertThr[k]) | (state & deassertThr[k]);
+            notEqual |= cnt[k] ^ thr;
+        }
+        uint16_t flip = diff & ~notEqual;
+
+        state ^= flip;
+        for (auto& c: cnt){
+            c &= ~flip;
+        }
+        return state;
+    }
+
+    bool isPending(uint16_t raw) const {
+        return (((raw ^ state) & ~passThroughMask()) | counterNonZero()) != 0;
+    }
+
+    uint16_t get() const {
+        return state;
+    }
+
+private:
+    static void setBit(uint16_t& word, uint16_t bit, bool val){
+        if (val){
+            word |= bit;
+        } else {
+            word &= ~bit;
+        }
+    }
+
+    uint16_t passThroughMask() const {
+        uint16_t nonZero = 0;
+        for (int k = 0; k < INPUT_FILTER_PLANES; k++){
+            nonZero |= (~state & assertThr[k]) | (state & deassertThr[k]);
+        }
+        return ~nonZero;
+    }
+
+    uint16_t counterNonZero() const {
+        uint16_t nonZero = 0;
+        for (auto c: cnt){
+            nonZero |= c;
+        }
+        return nonZero;
+    }
+
+    uint16_t state = 0;
+    uint16_t cnt[INPUT_FILTER_PLANES] = {};
+    uint16_t assertThr[INPUT_FILTER_PLANES] = {};
+    uint16_t deassertThr[INPUT_FILTER_PLANES] = {};
+    uint16_t integratorMask = 0;
+};
+
+#endif // INPUT_FILTER_H
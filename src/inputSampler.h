@@ -0,0 +1,93 @@
+#ifndef INPUT_SAMPLER_H
+#define INPUT_SAMPLER_H
+
+#include <utility>
+#include <vector>
+
+#include <Arduino.h>
+#undef B1
+#include <soc/gpio_reg.h>
+
+#include "pinDefs.h"
+
+// Reads all inputs from the GPIO input registers at once, instead
+// of calling digitalRead() for every pin.
+//
+// input_pin_table is compressed at compile time into "runs" - GPIOs
+// that are consecutive both in the register and in the INP word - so
+// gathering the INP word is one shift-and-mask per run (3 on r1.0).
+
+const int INPUT_PIN_COUNT = sizeof(input_pin_table) / sizeof(input_pin_table[0]);
+static_assert(INPUT_PIN_COUNT <= 16, "INP word is 16 bit wide");
+
+typedef struct {
+    uint8_t bank;      // 0: GPIO_IN_REG (0-31), 1: GPIO_IN1_REG (32-39)
+    uint8_t gpioFirst; // bit in the bank register
+    uint8_t bitFirst;  // bit in the INP word
+    uint8_t len;
+} gpioRun_t;
+
+typedef struct {
+    gpioRun_t runs[INPUT_PIN_COUNT];
+    int runCount;
+    bool usesBank1;
+} inputGather_t;
+
+constexpr inputGather_t buildInputGather(){
+    inputGather_t g = {};
+    for (int i = 0; i < INPUT_PIN_COUNT; i++){
+        uint8_t bank = input_pin_table[i] / 32;
+        uint8_t gpio = input_pin_table[i] % 32;
+
+        if (g.runCount > 0){
+            gpioRun_t& last = g.runs[g.runCount - 1];
+            if ((last.bank == bank) &&
+                (last.gpioFirst + last.len == gpio) &&
+                (last.bitFirst + last.len == i)){
+                last.len++;
+                continue;
+            }
+        }
+        g.runs[g.runCount] = {bank, gpio, (uint8_t)i, 1};
+        g.runCount++;
+        g.usesBank1 |= (bank == 1);
+    }
+    return g;
+}
+
+constexpr inputGather_t INPUT_GATHER = buildInputGather();
+
+template <int R>
+inline uint16_t gatherRun(uint32_t bank0, uint32_t bank1){
+    constexpr gpioRun_t run = INPUT_GATHER.runs[R];
+    constexpr uint32_t mask = (1UL << run.len) - 1;
+    uint32_t reg = (run.bank == 0) ? bank0 : bank1;
+    return ((reg >> run.gpioFirst) & mask) << run.bitFirst;
+}
+
+template <int... R>
+inline uint16_t gatherRuns(uint32_t bank0, uint32_t bank1, std::integer_sequence<int, R...>){
+    return (gatherRun<R>(bank0, bank1) | ... | 0);
+}
+
+inline uint16_t gatherInputs(uint32_t bank0, uint32_t bank1){
+    return gatherRuns(bank0, bank1,
+        std::make_integer_sequence<int, INPUT_GATHER.runCount>{});
+}
+
+// All inputs sampled at a single point in time - on r1.0 all inputs
+// sit in bank 0, so it's a single register read.
+inline uint16_t readInputSnapshot(){
+    if constexpr (INPUT_GATHER.usesBank1){
+        static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+        portENTER_CRITICAL(&mux);
+        uint32_t bank0 = REG_READ(GPIO_IN_REG);
+        uint32_t bank1 = REG_READ(GPIO_IN1_REG);
+        portEXIT_CRITICAL(&mux);
+        return gatherInputs(bank0, bank1);
+    } else {
+        return gatherInputs(REG_READ(GPIO_IN_REG), 0);
+    }
+}
+
+#endif // INPUT_SAMPLER_H
@@ -4,75 +4,271 @@
 #include "gracefulRestart.h"
 #include "commonFwUtils.h"
 
-bool isOutputType(antControllerIoType_t ioType){
-  return ioType == MOSFET ||
-         ioType == RELAY ||
-         ioType == OPTO ||
-         ioType == TTL;
+// A single bus job - separate writes would let a queued display
+// redraw in between them. Runs on the bus task, so the expander
+// writes below are executed right away.
+bool IoController::safeStateJob(void* p_ioController){
+    IoController* self = (IoController*)p_ioController;
+    bool isOk = true;
+    for (int i = 0; i < EXP_COUNT; i++){
+        isOk &= self->expanders[i].write(board::SAFE_WORDS[i], I2C_LANE_SAFETY);
+    }
+    return isOk;
 }
 
-void IoController::setDefaultState(){
-    for (auto &e: expanders){
-        e.write(PCA95x5::Level::L_ALL);
+typedef struct {
+    IoController* ioController;
+    std::shared_ptr<Config_> next;
+} configSwap_t;
+
+bool IoController::configSwapJob(void* p_swap){
+    configSwap_t* swap = (configSwap_t*)p_swap;
+    swap->ioController->applyConfig(swap->next);
+    return true;
+}
+
+// Publish hook of ConfigStore, called by the loader task. The swap is
+// an API lane job, so it never lands in the middle of an API call.
+void IoController::publishConfig(std::shared_ptr<Config_> next, void* p_ioController){
+    configSwap_t swap = {(IoController*)p_ioController, next};
+    while (!ControllerTask.run(CTRL_LANE_API, configSwapJob, &swap)){
+        vTaskDelay(CONFIG_SWAP_RETRY_MS / portTICK_PERIOD_MS);
     }
-    for (auto bGroup: Config.button_groups){
-        buttonHandler.resetOutputsForButtonGroup(bGroup.first);
+}
+
+// Runs on the controller task. Active buttons are carried over to the
+// new config, the old one is freed once no other task holds it.
+void IoController::applyConfig(std::shared_ptr<Config_> next){
+    holdStateUpdates(true);
+    configSnapshot_t old = ConfigStore.swap(next);
+    buttonHandler.remapButtons(*old);
+    markStateDirty(STATE_DIRTY_ALL_IO);
+    holdStateUpdates(false);
+}
+
+void IoController::setDefaultState(){
+    if (!I2cBus.run(I2C_LANE_SAFETY, safeStateJob, this)){
+        recordSafetyWriteFailure("safe state");
     }
+    markStateDirty(STATE_DIRTY_ALL_IO);
+    buttonHandler.clearActiveButtons();
     locked = false;
 }
 
 retCode_t IoController::init_controller_objects(){
-    init_expander(&expanders[EXP_MOSFETS], EXP_MOS_ADDR );
-    init_expander(&expanders[EXP_RELAYS],  EXP_REL_ADDR );
-    init_expander(&expanders[EXP_OPTO_TTL],EXP_OPTO_ADDR);
-
-    ioGroups.push_back(new O_group(MOSFET,&expanders[EXP_MOSFETS], 16, 0));
-    ioGroups.push_back(new O_group(RELAY, &expanders[EXP_RELAYS],  15, 0));
-    ioGroups.push_back(new O_group(OPTO,  &expanders[EXP_OPTO_TTL], 8, 8));
-    ioGroups.push_back(new O_group(TTL,   &expanders[EXP_OPTO_TTL], 8, 0));
-    ioGroups.push_back(new I_group(INP,   PIN_IN_BUFF_ENA, &input_pins));
+    for (int i = 0; i < EXP_COUNT; i++){
+        expanders[i].attach(*_wire, board::EXPANDER_ADDR[i]);
+    }
+    for (auto& desc: board::OUTPUTS){
+        outputs[desc.ioType].attach(&desc, &expanders[desc.exp]);
+    }
+    inputs.enable();
 
     setDefaultState();
     return RET_OK;
 }
 
-retCode_t IoController::init_expander(PCA9555* p_exp, int addr){
-    p_exp->attach(*_wire,addr);
+typedef struct {
+    uint16_t hwBits;
+    bool isRead;    // false if the expander could not be read
+    bool isOk;
+} expanderSync_t;
+
+typedef struct {
+    IoController* ioController;
+    bool verifyOnly;
+    expanderSync_t exps[EXP_COUNT];
+} resync_t;
+
+// Every expander in a single bus job - like commitJob(), a controller
+// job issues at most one bus job (see safetyBound.h). Runs on the bus
+// task, so the reads and writes below are executed right away.
+bool IoController::resyncJob(void* p_resync){
+    resync_t* resync = (resync_t*)p_resync;
+    bool allOk = true;
+    for (int i = 0; i < EXP_COUNT; i++){
+        ShadowExpander& e = resync->ioController->expanders[i];
+        expanderSync_t& sync = resync->exps[i];
+        uint32_t readErrors = e.getReadErrors();
+        sync.isOk = e.verify(&sync.hwBits);
+        sync.isRead = (e.getReadErrors() == readErrors);
+        if (!sync.isOk && !resync->verifyOnly){
+            // re-assert the shadow, it's already known to differ
+            sync.isOk = e.write(e.read());
+        }
+        allOk &= sync.isOk;
+    }
+    return allOk;
+}
 
-    p_exp->polarity(PCA95x5::Polarity::ORIGINAL_ALL);
-    p_exp->direction(PCA95x5::Direction::OUT_ALL);
-    bool write_status = p_exp->write(PCA95x5::Level::L_ALL);
+void IoController::resyncExpanders(JsonDocument& retJson, bool verifyOnly){
+    resync_t resync = {this, verifyOnly, {}};
+    bool allOk = I2cBus.run(I2C_LANE_API, resyncJob, &resync);
+
+    JsonArray expArray = retJson.createNestedArray("expanders");
+    for (int i = 0; i < EXP_COUNT; i++){
+        ShadowExpander& e = expanders[i];
+        const expanderSync_t& sync = resync.exps[i];
+
+        JsonObject expJson = expArray.createNestedObject();
+        expJson["addr"] = e.getAddr();
+        expJson["shadow"] = e.read();
+        // null if the expander could not be read
+        if (sync.isRead){
+            expJson["hw"] = sync.hwBits;
+        }
+        expJson["writeErrors"] = e.getWriteErrors();
+        expJson["readErrors"] = e.getReadErrors();
+        expJson["ok"] = sync.isOk;
+    }
+    retJson["msg"] = allOk ? "OK" : "ERR: expanders diverged";
+    retJson["retCode"] = allOk ? 200 : 500;
+}
 
-    ALOGT("init exp {:#02x}", addr);
+// Runs on the controller task. The write that failed already marked
+// its expanders diverged, the shadow holds the state to re-assert.
+void IoController::recordSafetyWriteFailure(const char* what){
+    safetyWriteFailures++;
+    safetyResyncPending = true;
+    ALOGE("{} write failed, outputs may still be on - resync pending", what);
+}
 
-    if (write_status){
-        ALOGT("Expander OK!");
-        return RET_OK;
+// Runs on the controller task - a single bus job, like an API resync,
+// but on the safety lane. Stays pending if it fails again.
+bool IoController::resyncSafetyWrites(){
+    if (!safetyResyncPending.exchange(false)){
+        return true;
+    }
+    resync_t resync = {this, false, {}};
+    if (!I2cBus.run(I2C_LANE_SAFETY, resyncJob, &resync)){
+        safetyResyncPending = true;
+        return false;
     }
-    ALOGE("Expander {:#02x} Error! Check the connections", addr);
-    return RET_ERR;
+    ALOGI("safety writes re-asserted");
+    return true;
 }
 
+static bool safetyResyncJob(void* p_ioController){
+    return ((IoController*)p_ioController)->resyncSafetyWrites();
+}
+
+// Called by the watchdog task on housekeeping. If the lane is full,
+// the flag stays set and the next housekeeping posts it again.
+void IoController::postSafetyResync(){
+    if (safetyResyncPending.load()){
+        ControllerTask.post(CTRL_LANE_GUARD, safetyResyncJob, this);
+    }
+}
 
-DynamicJsonDocument IoController::getIoControllerState(){
-    DynamicJsonDocument retJson(1024);
+void IoController::getIoControllerState(JsonDocument& retJson){
+    TraceSpan span(SPAN_STATE_JSON);
     JsonObject ioArray = retJson.createNestedObject("io");
 
-    for (auto& g: ioGroups){
-        g->getState(ioArray);
+    for (auto& g: outputs){
+        g.getState(ioArray);
     }
+    inputs.getState(ioArray);
     buttonHandler.getState(retJson);
 
     retJson["locked"] = locked;
     retJson["panic"] = inPanic;
+    retJson["seq"] = getStateSeq();
     retJson["msg"] = "OK";
     retJson["retCode"] = 200;
     ALOGT("Json bufer {}/{}b", retJson.memoryUsage(), retJson.capacity());
+}
+
+uint32_t IoController::getStateSeq(){
+    return stateSeq.load();
+}
+
+void IoController::markStateDirty(uint32_t ioMask, uint32_t groupMask){
+    dirtyIo.fetch_or(ioMask);
+    dirtyGroups.fetch_or(groupMask);
+    stateSeq.fetch_add(1);
+    if (stateHold.load() == 0){
+        notifyAttachedTask();
+    }
+}
+
+// Changes made while held are published as a single update, once released.
+void IoController::holdStateUpdates(bool shouldHold){
+    if (shouldHold){
+        stateHold.fetch_add(1);
+    } else if (stateHold.fetch_sub(1) == 1){
+        notifyAttachedTask();
+    }
+}
 
-    return retJson;
+// marks output groups whose bits differ from the "before" registers
+void IoController::markOutputsDirty(const uint16_t before[EXP_COUNT]){
+    uint32_t ioMask = 0;
+    for (auto& desc: board::OUTPUTS){
+        if ((before[desc.exp] ^ expanders[desc.exp].read()) & desc.regMask){
+            ioMask |= 0x01 << desc.ioType;
+        }
+    }
+    if (ioMask != 0){
+        markStateDirty(ioMask);
+    }
 }
 
-DynamicJsonDocument IoController::returnApiUnavailable(DynamicJsonDocument& retJson){
+// Only parts of the state changed since the last call, with the
+// sequence number of the newest change. Returns false, leaving retJson
+// empty, if nothing changed. After a config reload the whole state is
+// returned.
+bool IoController::getStateDelta(JsonDocument& retJson, bool* isFull){
+    if (stateHold.load() != 0){
+        return false;
+    }
+    uint32_t seq = stateSeq.load();
+    uint32_t ioMask = dirtyIo.load();
+    uint32_t groupMask = dirtyGroups.load();
+    deltaIo = ioMask;
+    deltaGroups = groupMask;
+
+    deltaGeneration = ConfigStore.active().generation;
+    *isFull |= (stateGeneration != deltaGeneration);
+    if (*isFull){
+        getIoControllerState(retJson);
+        return true;
+    }
+
+    if ((ioMask == 0) && (groupMask == 0)){
+        return false;
+    }
+
+    retJson["seq"] = seq;
+    if (ioMask & STATE_DIRTY_ALL_IO){
+        JsonObject ioArray = retJson.createNestedObject("io");
+        for (auto& g: outputs){
+            if (ioMask & (0x01 << g.ioType)){
+                g.getState(ioArray);
+            }
+        }
+        if (ioMask & (0x01 << INP)){
+            inputs.getState(ioArray);
+        }
+    }
+    if (groupMask != 0){
+        buttonHandler.getGroupState(retJson, groupMask);
+    }
+    if (ioMask & STATE_DIRTY_FLAGS){
+        retJson["locked"] = locked;
+        retJson["panic"] = inPanic;
+    }
+    return true;
+}
+
+// the event built by getStateDelta() was sent - only the changes it
+// covered are cleared
+void IoController::commitStateDelta(){
+    dirtyIo.fetch_and(~deltaIo);
+    dirtyGroups.fetch_and(~deltaGroups);
+    stateGeneration = deltaGeneration;
+}
+
+void IoController::returnApiUnavailable(JsonDocument& retJson){
     std::string msg = "Controller is ";
 
     if (inPanic){
@@ -82,40 +278,249 @@ DynamicJsonDocument IoController::returnApiUnavailable(DynamicJsonDocument& retJ
     }
     ALOGW(msg.c_str());
     retJson["msg"] = msg;
-    return retJson;
-
-    retJson["msg"] = "ERR: " + msg;
-    return retJson;
 }   
 
-DynamicJsonDocument IoController::handleApiCall(std::vector<std::string>& api_call){
-    DynamicJsonDocument retJson(1024);
+// Fills retJson, which is expected to be empty (see jsonPool.h).
+void IoController::handleApiCall(const apiCommand_t& cmd, JsonDocument& retJson){
+    switch (cmd.target){
+    case API_TARGET_INF:
+        getIoControllerState(retJson);
+        return;
 
-    if (api_call[0] == "INF"){
-        return getIoControllerState();
-    }
-    if (api_call[0] == "RST"){
+    case API_TARGET_RST:
         setDefaultState();
         gracefulRestart();
         retJson["msg"] = "OK";
+        return;
+
+    case API_TARGET_SYN:
+        resyncExpanders(retJson, cmd.op == API_OP_READ);
+        return;
+
+    case API_TARGET_BUS: {
+        if (cmd.op == API_OP_RESET){
+            I2cBus.resetStats();
+            ControllerTask.resetStats();
+        }
+        JsonObject busJson = retJson.createNestedObject("bus");
+        I2cBus.getStats(busJson);
+        JsonObject ctrlJson = retJson.createNestedObject("controller");
+        ControllerTask.getStats(ctrlJson);
+        retJson["msg"] = "OK";
+        retJson["retCode"] = 200;
+        return;
+    }
+
+    case API_TARGET_SAF:
+        getSafetyStats(retJson, cmd.op == API_OP_RESET);
+        return;
+
+    case API_TARGET_STATS: {
+        if (cmd.op == API_OP_RESET){
+            TraceSpans.reset();
+        }
+        JsonObject spansJson = retJson.createNestedObject("spans");
+        if (cmd.index == SPAN_COUNT){
+            TraceSpans.getStats(spansJson);
+        } else {
+            TraceSpans.getSpanStats((span_t)cmd.index, spansJson);
+        }
+        retJson["msg"] = "OK";
+        retJson["retCode"] = 200;
+        return;
+    }
+
+    case API_TARGET_BUT: {
+        if ((locked)||(inPanic)){ returnApiUnavailable(retJson); return;}
+        bool isOk = buttonHandler.apiAction(cmd);
+        retJson["msg"] = isOk ? "OK" : "ERR";
+        return;
+    }
+
+    case API_TARGET_IO: {
+        if ((locked)||(inPanic)){ returnApiUnavailable(retJson); return;}
+
+        if (cmd.ioType == INP){
+            inputs.apiAction(cmd, retJson);
+            return;
+        }
+        uint16_t before[EXP_COUNT];
+        getOutputWords(before);
+        outputs[cmd.ioType].apiAction(cmd, retJson);
+        markOutputsDirty(before);
+        return;
+    }
+
+    default: {
+        retJson["msg"] = cmd.error;
+        retJson["retCode"] = 500;
+        //append args for debugging
+        JsonArray args = retJson.createNestedArray("args");
+        for (int i = 0; i < cmd.argc; i++){
+            args.add(cmd.args[i]);
+        }
+        return;
+    }
+    }
+}
+
+void IoController::getSafetyStats(JsonDocument& retJson, bool reset){
+    if (reset){
+        panicLatency.reset();
+        lockLatency.reset();
+        safetyWriteFailures = 0;
+    }
+    JsonObject panicJson = retJson.createNestedObject("panic");
+    panicLatency.getStats(panicJson);
+    JsonObject lockJson = retJson.createNestedObject("lock");
+    lockLatency.getStats(lockJson);
+    retJson["boundUs"] = SAFETY_REACTION_BOUND_US;
+    retJson["writeFailures"] = safetyWriteFailures.load();
+    retJson["resyncPending"] = safetyResyncPending.load();
+    retJson["msg"] = "OK";
+    retJson["retCode"] = 200;
+}
+
+// Binary counterpart of /api/INF and the output /bits calls,
+// see binaryFrame.h. An empty request only reads the state.
+binStatus_t IoController::handleBinaryFrame(const uint8_t* data, size_t len, binStateFrame_t& reply){
+    binStatus_t status = BIN_OK;
+    if (len > 0){
+        status = applyWriteFrame(data, len);
+    }
+    getStateFrame(reply);
+    reply.status = status;
+    return status;
+}
+
+void IoController::getStateFrame(binStateFrame_t& frame){
+    frame = {};
+    frame.magic = BIN_MAGIC_STATE;
+    frame.version = BIN_PROTO_VERSION;
+    frame.flags = (locked ? BIN_FLAG_LOCKED : 0) | (inPanic ? BIN_FLAG_PANIC : 0);
+    frame.seq = getStateSeq();
+    const Config_& cfg = ConfigStore.active();
+    frame.generation = cfg.generation;
+    for (auto& g: outputs){
+        frame.outputs[g.ioType] = g.get_bits();
     }
+    frame.inputs = inputs.get_bits();
+    frame.groupCount = cfg.button_groups.size();
+    for (int i = 0; i < MAX_BUTTON_GROUPS; i++){
+        frame.activeButtons[i] = buttonHandler.getActiveButton(i);
+    }
+}
+
+// Every op is validated before anything is written, then all of them
+// are committed as one transaction - a single register write per expander.
+binStatus_t IoController::applyWriteFrame(const uint8_t* data, size_t len){
+    binWriteHeader_t header;
+    if (len < sizeof(header)){
+        return BIN_ERR_FRAME;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != BIN_MAGIC_WRITE){
+        return BIN_ERR_FRAME;
+    }
+    if (header.version != BIN_PROTO_VERSION){
+        return BIN_ERR_VERSION;
+    }
+    if ((header.opCount > BIN_MAX_WRITE_OPS) ||
+        (len != sizeof(header) + header.opCount * sizeof(binWriteOp_t))){
+        return BIN_ERR_FRAME;
+    }
+    if ((locked)||(inPanic)){
+        return BIN_ERR_LOCKED;
+    }
+
+    uint16_t words[EXP_COUNT];
+    getOutputWords(words);
+    outputTransaction_t tx = beginTransaction();
+
+    const uint8_t* p = data + sizeof(header);
+    for (int i = 0; i < header.opCount; i++, p += sizeof(binWriteOp_t)){
+        binWriteOp_t op;
+        memcpy(&op, p, sizeof(op));
+        if (!isOutputType((antControllerIoType_t)op.ioType)){
+            return BIN_ERR_ARG;
+        }
+        const outputGroupDesc_t& desc = board::OUTPUTS[op.ioType];
+        if (op.mask & ~desc.bitMask){
+            return BIN_ERR_ARG;
+        }
+        uint16_t regMask = op.mask << desc.offs;
+        switch (op.op){
+        case BIN_OP_SET:
+            words[desc.exp] |= regMask;
+            break;
+        case BIN_OP_CLEAR:
+            words[desc.exp] &= ~regMask;
+            break;
+        case BIN_OP_TOGGLE:
+            words[desc.exp] ^= regMask;
+            break;
+        default:
+            return BIN_ERR_ARG;
+        }
+        tx.mask[desc.exp] |= regMask;
+    }
+    for (int i = 0; i < EXP_COUNT; i++){
+        tx.bits[i] = words[i];
+    }
+    return commitTransaction(tx) ? BIN_OK : BIN_ERR_BUS;
+}
+
+// Every command is staged into one plan first, guards are evaluated
+// once on the final state, and everything is committed as a single
+// break/make pair. Nothing is written if any command fails.
+void IoController::handleBatch(const apiCommand_t* cmds, int count, JsonDocument& retJson){
+    if ((locked)||(inPanic)){ returnApiUnavailable(retJson); return;}
 
-    if (api_call[0] == "BUT"){
-        if ((locked)||(inPanic)){ return returnApiUnavailable(retJson);}
+    if ((count <= 0) || (count > BATCH_MAX_COMMANDS)){
+        retJson["msg"] = "ERR: invalid command count";
+        retJson["retCode"] = 500;
+        return;
+    }
 
-        std::string ret = buttonHandler.apiAction(api_call)? "OK" : "ERR";
-        retJson["msg"] = ret;
-        return retJson;
+    buttonPlan_t plan;
+    buttonHandler.beginPlan(plan);
+
+    JsonArray results = retJson.createNestedArray("results");
+    bool isOk = true;
+    for (int i = 0; i < count; i++){
+        const apiCommand_t& cmd = cmds[i];
+        const char* err = cmd.error;
+
+        if (cmd.target == API_TARGET_BUT){
+            buttonHandler.planButton(plan, cmd.index, cmd.value);
+        } else if ((cmd.target == API_TARGET_IO) && isOutputType(cmd.ioType)){
+            outputTransaction_t tx = beginTransaction();
+            err = outputs[cmd.ioType].stageApiAction(cmd, tx);
+            stageTransaction(plan.makeTx, tx);
+        } else if (err == NULL){
+            err = "ERR: not allowed in batch";
+        }
+        results.add(err == NULL ? "OK" : err);
+        isOk &= (err == NULL);
     }
-    for(IoGroup* group: ioGroups){
-        if (group->tag == api_call[0]){
-            if ((locked)||(inPanic)){ return returnApiUnavailable(retJson);}
 
-            return group->apiAction(api_call);
+    if (isOk){
+        int prevented = buttonHandler.checkPlan(plan);
+        if (prevented != BUTTON_NONE){
+            retJson["msg"] = "ERR: prevented by pin guards: " + ConfigStore.active().buttons[prevented].name;
+            retJson["retCode"] = 500;
+            return;
+        }
+        if (!buttonHandler.commitPlan(plan)){
+            retJson["seq"] = getStateSeq();
+            retJson["msg"] = "ERR: expander write failed";
+            retJson["retCode"] = 500;
+            return;
         }
     }
-    retJson["msg"] = "ERR: API call for tag " + api_call[0] + " not found";
-    return retJson;
+    retJson["seq"] = getStateSeq();
+    retJson["msg"] = isOk ? "OK" : "ERR: batch not applied";
+    retJson["retCode"] = isOk ? 200 : 500;
 }
 
 void IoController::setOutput(antControllerIoType_t ioType, int pin_num, bool val){
@@ -123,32 +528,139 @@ void IoController::setOutput(antControllerIoType_t ioType, int pin_num, bool val
         ALOGE("{} is not an output!", ioTypeMap.at(ioType));
         return;
     }
-    for (auto& g: ioGroups){
-        if (g->ioType == ioType){
-            O_group* group = (O_group*)g;
-            group->set_output(pin_num, val);
-            return;
+    outputs[ioType].set_output(pin_num, val);
+}
+
+outputTransaction_t IoController::beginTransaction(){
+    outputTransaction_t tx = {};
+    return tx;
+}
+
+bool IoController::stageOutput(outputTransaction_t& tx, antControllerIoType_t ioType, int pin_num, bool val){
+    if (!isOutputType(ioType)){
+        ALOGE("{} is not an output!", ioTypeMap.at(ioType));
+        return false;
+    }
+    return outputs[ioType].stage_output(tx, pin_num, val);
+}
+
+// "break" and "make"
+const int COMMIT_PHASES = 2;
+
+typedef struct {
+    IoController* ioController;
+    uint16_t words[COMMIT_PHASES][EXP_COUNT];
+    uint32_t writeMask[COMMIT_PHASES];  // bit per expander
+    i2cLane_t lane;
+} txCommit_t;
+
+// All the registers of a commit in a single bus job, same as
+// safeStateJob() - a display transfer can't get in between them, nor
+// stretch the dead-time between the phases. Nothing is made, if
+// the "break" phase failed.
+bool IoController::commitJob(void* p_commit){
+    txCommit_t* commit = (txCommit_t*)p_commit;
+    for (int phase = 0; phase < COMMIT_PHASES; phase++){
+        if (commit->writeMask[phase] == 0){
+            continue;
+        }
+        if ((phase > 0) && (commit->writeMask[phase - 1] != 0)){
+            // measured from the completion of the previous phase
+            delayMicroseconds(BREAK_BEFORE_MAKE_US);
+        }
+        bool isOk = true;
+        for (int i = 0; i < EXP_COUNT; i++){
+            if ((commit->writeMask[phase] >> i) & 0x01){
+                isOk &= commit->ioController->expanders[i].write(
+                    commit->words[phase][i], commit->lane);
+            }
+        }
+        if (!isOk){
+            return false;
         }
     }
+    return true;
 }
 
-bool IoController::getIoValue(antControllerIoType_t ioType, int pin_num){
-    for (auto& g: ioGroups){
-        if (g->ioType == ioType){
-            return g->isPinHigh(pin_num);
+// Applies staged phases, each on top of the previous one, writing only
+// expanders whose register actually changes. Returns false if any
+// write failed - the shadow keeps the requested state, to be
+// re-asserted by resync. Transactions are cleared.
+bool IoController::commitPhases(outputTransaction_t* txs, int phases, i2cLane_t lane){
+    uint16_t before[EXP_COUNT];
+    getOutputWords(before);
+
+    txCommit_t commit = {this, {}, {}, lane};
+    const uint16_t* prev = before;
+    uint32_t anyWrite = 0;
+    for (int phase = 0; phase < phases; phase++){
+        const outputTransaction_t& tx = txs[phase];
+        for (int i = 0; i < EXP_COUNT; i++){
+            commit.words[phase][i] = (prev[i] & ~tx.mask[i]) | (tx.bits[i] & tx.mask[i]);
+            if (commit.words[phase][i] != prev[i]){
+                commit.writeMask[phase] |= (uint32_t)0x01 << i;
+            }
         }
+        anyWrite |= commit.writeMask[phase];
+        prev = commit.words[phase];
+        txs[phase] = {};
+    }
+
+    bool isOk = true;
+    if (anyWrite != 0){
+        isOk = I2cBus.run(lane, commitJob, &commit);
+        markOutputsDirty(before);
+    }
+    return isOk;
+}
+
+bool IoController::commitTransaction(outputTransaction_t& tx, i2cLane_t lane){
+    return commitPhases(&tx, 1, lane);
+}
+
+// breakTx, then makeTx after BREAK_BEFORE_MAKE_US - the dead-time is
+// skipped, if either of them doesn't write anything.
+bool IoController::commitBreakMake(outputTransaction_t& breakTx, outputTransaction_t& makeTx){
+    outputTransaction_t txs[COMMIT_PHASES] = {breakTx, makeTx};
+    bool isOk = commitPhases(txs, COMMIT_PHASES, I2C_LANE_API);
+    breakTx = {};
+    makeTx = {};
+    return isOk;
+}
+
+// current expander registers, from the shadow
+void IoController::getOutputWords(uint16_t words[EXP_COUNT]){
+    for (int i = 0; i < EXP_COUNT; i++){
+        words[i] = expanders[i].read();
     }
-    ALOGE("IO type {} not found", ioTypeMap.at(ioType));
-    return false;
+}
+
+// expander registers as they would be after committing tx
+void IoController::applyTransaction(const outputTransaction_t& tx, uint16_t words[EXP_COUNT]){
+    for (int i = 0; i < EXP_COUNT; i++){
+        words[i] = (words[i] & ~tx.mask[i]) | (tx.bits[i] & tx.mask[i]);
+    }
+}
+
+bool IoController::getIoValue(antControllerIoType_t ioType, int pin_num){
+    if (ioType == INP){
+        return inputs.isPinHigh(pin_num);
+    }
+    if (!isOutputType(ioType)){
+        ALOGE("IO type {} not found", (int)ioType);
+        return false;
+    }
+    return outputs[ioType].isPinHigh(pin_num);
 }
 
 uint16_t IoController::getGroupBits(antControllerIoType_t ioType){
-    for (auto& g: ioGroups){
-        if (g->ioType == ioType){
-            return g->get_bits();
-        }
+    if (ioType == INP){
+        return inputs.get_bits();
+    }
+    if (!isOutputType(ioType)){
+        return 0; //TODO handle errors?
     }
-    return 0; //TODO handle errors?
+    return outputs[ioType].get_bits();
 }
 
 void IoController::attachNotifyTaskHandle(TaskHandle_t taskHandle){
@@ -158,7 +670,6 @@ void IoController::attachNotifyTaskHandle(TaskHandle_t taskHandle){
 void IoController::notifyAttachedTask(){
     if (notifyTaskHandle != NULL){
         xTaskNotifyGive(notifyTaskHandle);
-        ALOGT("Notifying task {}", notifyTaskHandle);
     }
 }
 
@@ -173,47 +684,174 @@ void IoController::setPanic(bool shouldPanic){
         ALOGV("Panic! outputs set to default");
         inPanic = true;
     }
-
-    notifyAttachedTask();
+    markStateDirty(STATE_DIRTY_FLAGS);
 }
 
 void IoController::setLocked(bool shouldLock){
     if (shouldLock == locked) return;
     locked = shouldLock;
-
-    notifyAttachedTask();
+    markStateDirty(STATE_DIRTY_FLAGS);
 }
 
 void IoController::notifyOnBitsChange(uint16_t bits){
     static uint16_t lastBits = 0;
+    static uint32_t guardGeneration = 0;
 
-    if (bits == lastBits) return;
+    uint16_t changedBits = bits ^ lastBits;
     lastBits = bits;
 
-    //TODO: optimize this so only changed bits are checked.
-    buttonHandler.recheckPinGuards(true);
-    notifyAttachedTask();
+    uint32_t generation = ConfigStore.active().generation;
+    if (guardGeneration != generation){
+        // guards were recompiled - all inputs have to be checked
+        guardGeneration = generation;
+        buttonHandler.checkInputGuards(bits, 0xFFFF);
+    } else if (changedBits != 0){
+        buttonHandler.checkInputGuards(bits, changedBits);
+    }
+
+    if (changedBits != 0){
+        markStateDirty(0x01 << INP);
+    }
+}
+
+// Runs on the controller task. Panic goes first, it's the only one
+// writing outputs - and it clears the lock, which is then re-applied.
+void IoController::handleInputBits(uint16_t bits, uint32_t edgeUs){
+    bool wasPanic = inPanic;
+    setPanic(((bits >> INPUT_PANIC_BIT) & 0x01) == HIGH);
+    if (inPanic && !wasPanic){
+        panicLatency.record(micros() - edgeUs);
+    }
+
+    bool wasLocked = locked;
+    setLocked(((bits >> INPUT_LOCK_BIT) & 0x01) == LOW);
+    if (locked && !wasLocked){
+        lockLatency.record(micros() - edgeUs);
+    }
+    notifyOnBitsChange(bits);
+}
+
+static bool inputBitsJob(void* p_ioController){
+    ((IoController*)p_ioController)->applyLatestInputBits();
+    return true;
+}
+
+void IoController::applyLatestInputBits(){
+    // cleared first, so a change made from now on is posted again
+    inputJobQueued = false;
+    uint16_t bits = latestInputBits.load();
+    uint32_t edgeUs = safetyEdgeUs.load();
+    // a panic pulse, gone before the job ran, still resets outputs
+    if (panicSeen.exchange(false)){
+        handleInputBits(bits | (0x01 << INPUT_PANIC_BIT), edgeUs);
+    }
+    handleInputBits(bits, edgeUs);
+}
+
+// Called by the watchdog task. Jobs don't carry the bits, they apply
+// the latest ones - so a lock/panic change may overtake a queued guard
+// job, and a burst of edges is coalesced into a single queued job.
+void IoController::postInputBits(uint16_t bits, uint32_t edgeUs){
+    // the watchdog task is the only writer, the edge timestamp is
+    // published before the bits it belongs to
+    uint16_t changedBits = bits ^ latestInputBits.load();
+    if (changedBits & INPUT_SAFETY_MASK){
+        safetyEdgeUs = edgeUs;
+    }
+    latestInputBits = bits;
+    if ((bits >> INPUT_PANIC_BIT) & 0x01){
+        panicSeen = true;
+    }
+    if (changedBits & INPUT_SAFETY_MASK){
+        ControllerTask.post(CTRL_LANE_PANIC, inputBitsJob, this);
+    } else if (!inputJobQueued.exchange(true)){
+        if (!ControllerTask.post(CTRL_LANE_GUARD, inputBitsJob, this)){
+            inputJobQueued = false;
+        }
+    }
+}
+
+void IoController::applyInputFilters(const Config_& config){
+    InputFilter& filter = inputs.filter;
+
+    filter.clearConfig();
+    for (auto& pin: config.pins){
+        if (pin.ioType != INP){
+            continue;
+        }
+        filter.configure(pin.ioNum, pin.filterMode,
+            pin.assertMs / INPUT_FILTER_TICK_MS,
+            pin.deassertMs / INPUT_FILTER_TICK_MS);
+        if ((pin.assertMs > 0) || (pin.deassertMs > 0)){
+            ALOGD("input {} filtered: {}ms/{}ms", pin.name,
+                pin.assertMs, pin.deassertMs);
+        }
+    }
 }
 
 void WatchdogTask(void *p_ioController){
     IoController* ioController = (IoController*)p_ioController;
+    InputCapture& capture = ioController->inputs.capture;
+    InputFilter& filter = ioController->inputs.filter;
+    uint32_t filterGeneration = 0;
     int loop = 0;
 
-    TickType_t xLastWakeTime;
-    xLastWakeTime = xTaskGetTickCount();
+    uint16_t rawBits = ioController->inputs.read_raw_bits();
+    filter.reset(rawBits);
+    ioController->postInputBits(filter.get(), micros());
+    // debounced changes are timed from the edge that started them
+    uint32_t lastEdgeUs = micros();
+
+    TickType_t lastHousekeeping = xTaskGetTickCount();
+    TickType_t lastFilterTick = lastHousekeeping;
     for( ;; ){
-        if (digitalRead(PIN_INPUT_1) == LOW){
-            ioController->setLocked(true);
-        } else {
-            ioController->setLocked(false);
+        // woken up by edge interrupts, every filter tick while an input
+        // is being debounced, or periodically for housekeeping
+        int timeoutMs = filter.isPending(rawBits) ?
+            INPUT_FILTER_TICK_MS : WATCHDOG_PERIOD_MS;
+        ulTaskNotifyTake(pdTRUE, timeoutMs / portTICK_PERIOD_MS);
+
+        // each edge is handled separately, so short pulses are not lost
+        inputEdge_t edge;
+        while (capture.pop(&edge)){
+            capture.recordLatency(micros() - edge.timestampUs);
+            if (edge.level){
+                rawBits |= (uint16_t)0x01 << edge.input;
+            } else {
+                rawBits &= ~((uint16_t)0x01 << edge.input);
+            }
+            lastEdgeUs = edge.timestampUs;
+            ioController->postInputBits(filter.sample(rawBits), lastEdgeUs);
         }
 
-        if (digitalRead(PIN_INPUT_3) == HIGH){
-            ioController->setPanic(true);
-        } else {
-            ioController->setPanic(false);
+        TickType_t now = xTaskGetTickCount();
+        if (now - lastFilterTick >= INPUT_FILTER_TICK_MS / portTICK_PERIOD_MS){
+            lastFilterTick = now;
+            if (filter.isPending(rawBits)){
+                ioController->postInputBits(filter.tick(rawBits), lastEdgeUs);
+            }
+        }
+
+        if (now - lastHousekeeping < WATCHDOG_PERIOD_MS / portTICK_PERIOD_MS){
+            continue;
+        }
+        lastHousekeeping = now;
+
+        // a snapshot, so a config published meanwhile can't free it
+        configSnapshot_t config = ConfigStore.get();
+        if (filterGeneration != config->generation){
+            filterGeneration = config->generation;
+            ioController->applyInputFilters(*config);
+        }
+
+        // edges may be dropped if the ring overflows - resample levels
+        uint16_t sampledBits = ioController->inputs.read_raw_bits();
+        if (sampledBits != rawBits){
+            rawBits = sampledBits;
+            lastEdgeUs = micros();
+            ioController->postInputBits(filter.sample(rawBits), lastEdgeUs);
         }
-        ioController->notifyOnBitsChange(ioController->getGroupBits(INP));
+        ioController->postSafetyResync();
 
         if (loop++ % 4 == 0){
             if (ioController->locked){
@@ -222,11 +860,11 @@ void WatchdogTask(void *p_ioController){
                 handle_io_pattern(PIN_LED_STATUS, PATTERN_HBEAT);
             }    
         }        
-        vTaskDelayUntil( &xLastWakeTime, 25 / portTICK_PERIOD_MS);
     }
 }
 
 void IoController::spawnWatchdogTask(){
     xTaskCreate( WatchdogTask, "IoC Watchdog",
-            4000, this, 20, NULL );
+            4000, this, 20, &watchdogTaskHandle );
+    inputs.startCapture(watchdogTaskHandle);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef IO_CONTROLLER_H
 #define IO_CONTROLLER_H
 
+#include <atomic>
 #include <vector>
 
 #include <Arduino.h>
@@ -9,254 +10,196 @@
 #include "ArduinoJson.h"
 
 #include "ioControllerTypes.h"
+#include "boardDesc.h"
+#include "binaryFrame.h"
+#include "apiCommand.h"
+#include "shadowExpander.h"
+#include "inputCapture.h"
+#include "inputSampler.h"
 #include "configHandler.h"
 #include "pinDefs.h"
+#include "controllerTask.h"
+#include "latencyHistogram.h"
+#include "traceSpan.h"
+#include "safetyBound.h"
 
 #include "buttonHandler.h"
 
-const int EXP_MOS_ADDR = 0x20;
-const int EXP_REL_ADDR = 0x21;
-const int EXP_OPTO_ADDR = 0x22;
+// gap between "break" and "make" commits when switching buttons
+const int BREAK_BEFORE_MAKE_US = safety::BREAK_BEFORE_MAKE_US;
+const int BATCH_MAX_COMMANDS = 16;
 
+// special inputs, as bit numbers in INP word
+const int INPUT_LOCK_BIT = 0;  // PIN_INPUT_1, lock on low
+const int INPUT_PANIC_BIT = 2; // PIN_INPUT_3, panic on high
+const uint16_t INPUT_SAFETY_MASK = (0x01 << INPUT_LOCK_BIT) | (0x01 << INPUT_PANIC_BIT);
 
-class IoGroup {
+// edge on a safety input -> safe state committed, see safetyBound.h
+const uint32_t SAFETY_REACTION_BOUND_US = safety::reactionBoundUs(EXP_COUNT);
 
-  protected:
-    IoGroup(antControllerIoType_t ioType){
-      this->ioType = ioType;
-      this->tag = std::string(ioTypeMap.at(ioType));
-    }
+// housekeeping period of the watchdog (input sampler) task, when no
+// edges come in
+const int WATCHDOG_PERIOD_MS = 25;
 
-  public:
+// how long a config publish waits, if the API lane is full
+const int CONFIG_SWAP_RETRY_MS = 10;
 
-    bool tryParseApiArguments(std::vector<std::string>& api_call, DynamicJsonDocument& jsonRef){
-        switch (api_call.size()){
-        case 0:
-        case 1:
-          jsonRef["msg"] = "ERR: no parameter";
-          jsonRef["retCode"] = 500;
-          return false;
-        case 2:
-          jsonRef["parameter"] = api_call[1];
-          jsonRef["value"] = "";
-          return true;
-        case 3:
-          jsonRef["parameter"] = api_call[1];
-          jsonRef["value"] = api_call[2];
-          return true;
-        default:
-          jsonRef["msg"] = "ERR: too many parameters";
-          jsonRef["retCode"] = 500;
-          return false;
-      }
-    }
+// state change tracking - bit per antControllerIoType_t, plus lock/panic
+const uint32_t STATE_DIRTY_FLAGS = 0x01 << OUT_TYPE_COUNT;
+const uint32_t STATE_DIRTY_ALL_IO = (0x01 << OUT_TYPE_COUNT) - 1;
 
-    DynamicJsonDocument apiAction(std::vector<std::string>& api_call){
-      ALOGI("API call for tag {}",
-        tag.c_str(), api_call.size());
 
-      DynamicJsonDocument retJson(1024);
+// Common API handling of IO groups. Static polymorphism - the
+// derived group is known at compile time, so there are no virtual calls.
+template <typename T>
+class IoGroup {
 
-      if (!tryParseApiArguments(api_call, retJson)){
-        //append args for debugging
-        JsonArray args = retJson.createNestedArray("args");
-        for (int i = 0; i<api_call.size(); i++){
-            args[i] = api_call[i];
-        }
-        return retJson;
-      } else {
-        ioOperation(retJson);
-        return retJson;
-      }
+  protected:
+    void setIoType(antControllerIoType_t ioType){
+      this->ioType = ioType;
+      this->tag = ioTypeMap.at(ioType);
     }
 
-    int intFromString(std::string& str){
-      if (str.length() == 0){
-        return -1;
-      }
-      //check if std::string contains any non-digit characters
-      for (int i = 0; i < str.length(); i++){
-        if (!isDigit(str.at(i))){
-          return -1;
-        }
-      }
-      return std::stoi(str);
+  public:
+
+    // cmd is already validated by parseApiCommand()
+    void apiAction(const apiCommand_t& cmd, JsonDocument& retJson){
+      retJson["parameter"] = cmd.args[1];
+      retJson["value"] = (cmd.argc > 2) ? cmd.args[2] : std::string_view();
+      static_cast<T*>(this)->ioOperation(cmd, retJson);
     }
 
-    void appendJsonStatus(DynamicJsonDocument& jsonRef, bool isSucc, const char* msg){
+    void appendJsonStatus(JsonDocument& jsonRef, bool isSucc, const char* msg){
       jsonRef["msg"] = msg;
       jsonRef["retCode"] = isSucc ? 200 : 500;
     }
 
     antControllerIoType_t ioType;
-    std::string tag;
-    virtual void resetOutputs() = 0;
-    virtual void getState(JsonObject& jsonRef) = 0;
-    virtual bool isPinHigh(int pin_num) = 0;
-    virtual uint16_t get_bits() = 0;
-
-  private:
-    virtual void ioOperation(DynamicJsonDocument& jsonRef) = 0;
+    const char* tag = "";
 };
 
-class O_group : public IoGroup {
+class O_group : public IoGroup<O_group> {
   public:
-    O_group(antControllerIoType_t ioType, PCA9555* p_exp, int out_num, int out_offs)
-     : IoGroup(ioType){
-      this->out_num = out_num;
-      this->out_offs = out_offs;
-
+    void attach(const outputGroupDesc_t* desc, ShadowExpander* p_exp){
+      setIoType(desc->ioType);
+      this->desc = desc;
       this->expander = p_exp;
     }
 
-    bool set_output(int pin_num, bool val){
-      if (pin_num >= out_num){
+    bool stage_output(outputTransaction_t& tx, int pin_num, bool val){
+      if ((pin_num < 0) || (pin_num >= desc->width)){
         return false;
       }
-      if (pin_num < 0){
+      uint16_t mask = (uint16_t)0x01 << (pin_num + desc->offs);
+
+      tx.mask[desc->exp] |= mask;
+      if (val){
+        tx.bits[desc->exp] |= mask;
+      } else {
+        tx.bits[desc->exp] &= ~mask;
+      }
+      return true;
+    }
+
+    void stage_output_bits(outputTransaction_t& tx, uint16_t bits){
+      tx.mask[desc->exp] |= desc->regMask;
+      tx.bits[desc->exp] = (tx.bits[desc->exp] & ~desc->regMask) | (bits << desc->offs);
+    }
+
+    bool set_output(int pin_num, bool val){
+      if ((pin_num < 0) || (pin_num >= desc->width)){
         return false;
       }
 
-      int offs_pin = pin_num + out_offs;
+      int offs_pin = pin_num + desc->offs;
 
       ALOGT("set pin {} {} @ {}",
         offs_pin,
         val ? "on" : "off",
-        tag.c_str()
+        tag
       );
-      expander->write(
-        (PCA95x5::Port::Port) offs_pin,
-        (PCA95x5::Level::Level )val
-      );
-      return true;
+      return expander->writePin(offs_pin, val);
     }
 
     bool set_output_bits(uint16_t bits){
-      int bit_range = pow(2,out_num);
-      if (bits >= bit_range){
+      if (bits & ~desc->bitMask){
         // bits are out of range
         ALOGE("Cannot write bits {:#04x} as it exceeds {:#04x} on {}",
-          bits, bit_range, tag.c_str());
+          bits, desc->bitMask, tag);
         return false;
       }
-      ALOGI("Write bits {:#04x} on {}",bits, tag.c_str());
-      bits &= (0xFFFF >> 16-out_num);
-      bits <<= out_offs;
-      bits |= expander->read() & ~(0xFFFF >> 16-out_num << out_offs);
-      expander->write(bits);
-      return true;
+      ALOGI("Write bits {:#04x} on {}",bits, tag);
+      return expander->writeMasked(desc->regMask, bits << desc->offs);
     }
 
     uint16_t get_bits(){
-      uint16_t bits = expander->read();
-      bits >>= out_offs;
-      bits &= (0xFFFF >> 16-out_num);
-      return bits;
-    }
-
-    int tryGetPinByParameter(std::string& parameter){
-      int parameter_int_offs = intFromString(parameter);
-      if (parameter_int_offs > 0){
-        parameter_int_offs -= 1; // API pin parameters start from 1
-        if (parameter_int_offs >= out_num){
-          return -1;
-        }
-        return parameter_int_offs;
-      } else {
-        return -1;
-      }
+      return (expander->read() & desc->regMask) >> desc->offs;
     }
 
     bool isPinHigh(int pin_num){
-      return expander->read(
-        (PCA95x5::Port::Port) (pin_num + out_offs)
-      );
+      return expander->isPinHigh(pin_num + desc->offs);
     }
 
-    bool tryWritePinByParam(int pinOffs, std::string& parameter){
-      if (parameter.find("on") != std::string::npos) {
-        return set_output(pinOffs, true);
-      } else if (parameter.find("off") != std::string::npos) {
-        return set_output(pinOffs, false);
-      } else {
-        return false;
-      }
-    }
-
-    void ioOperation(DynamicJsonDocument& jsonRef){
-      std::string parameter = jsonRef["parameter"].as<std::string>();
-      std::string value = jsonRef["value"].as<std::string>();
-
-      //try to find a pin based on integer or pin name
-      int expPinByParam = tryGetPinByParameter(parameter);
-      if (expPinByParam >= 0){
-        //handle calls for specific pin
-        if (value.empty()){
-          bool isHigh = isPinHigh(expPinByParam);
-          jsonRef["pinState"] = isHigh ? "on" : "off";
-          jsonRef["pinNum"] = expPinByParam + 1;
+    void ioOperation(const apiCommand_t& cmd, JsonDocument& jsonRef){
+      if (cmd.selector == API_SEL_PIN){
+        if (cmd.op == API_OP_READ){
+          jsonRef["pinState"] = isPinHigh(cmd.index) ? "on" : "off";
+          jsonRef["pinNum"] = cmd.index + 1;
           appendJsonStatus(jsonRef, true, "Read pin ok");
-          return;
         } else {
-          bool is_succ = tryWritePinByParam(expPinByParam, value);
-          if (is_succ){
-            appendJsonStatus(jsonRef, true, "Write pin ok");
-            return;
-          } else {
-            appendJsonStatus(jsonRef, false, "Write pin failed");
-            return;
-          }
+          bool is_succ = set_output(cmd.index, cmd.value);
+          appendJsonStatus(jsonRef, is_succ, is_succ ? "Write pin ok" : "Write pin failed");
         }
-      } else if (parameter == "bits"){
-        if (value.length() == 0){
-          //read pins
+      } else {
+        if (cmd.op == API_OP_READ){
           appendJsonStatus(jsonRef, true, "Read bits ok");
           jsonRef["bits"] = get_bits();
-          return;
-        }
-        int bits = intFromString(value);
-        if ((bits < 0)||(bits > 0xFFFF)){
-          appendJsonStatus(jsonRef, false, "ERR: invalid bits");
-          return;
         } else {
-          set_output_bits((uint16_t)bits);
-          appendJsonStatus(jsonRef, true, "Write bits ok");
-          return;
+          bool is_succ = set_output_bits((uint16_t)cmd.value);
+          appendJsonStatus(jsonRef, is_succ, is_succ ? "Write bits ok" : "Write bits failed");
         }
+      }
+    }
+
+    // Write calls of ioOperation(), staged into tx instead of written.
+    // Returns NULL on success, or an error message.
+    const char* stageApiAction(const apiCommand_t& cmd, outputTransaction_t& tx){
+      if (cmd.op != API_OP_WRITE){
+        return "ERR: not allowed in batch";
+      }
+      if (cmd.selector == API_SEL_PIN){
+        stage_output(tx, cmd.index, cmd.value);
       } else {
-        appendJsonStatus(jsonRef, false, "ERR: invalid parameter");
-        return;
+        stage_output_bits(tx, (uint16_t)cmd.value);
       }
+      return NULL;
     }
 
     void getState(JsonObject& jsonRef){
       JsonObject currentTagData = jsonRef.createNestedObject(tag);
       currentTagData["type"] = "output";
       currentTagData["bits"] = get_bits();
-      currentTagData["ioNum"] = out_num;
+      currentTagData["ioNum"] = desc->width;
       return;
     }
 
-    void resetOutputs() override{
+    void resetOutputs(){
       set_output_bits(0x00);
     }
 
   private:
-    PCA9555* expander;
-    int out_num;
-    int out_offs;
+    const outputGroupDesc_t* desc = NULL;
+    ShadowExpander* expander = NULL;
 };
 
-class I_group: public IoGroup {
+class I_group: public IoGroup<I_group> {
   public:
     I_group(
-        antControllerIoType_t ioType,
         int pin_in_buff_ena,
-        const std::vector<uint8_t> *pins )
-    : IoGroup(ioType){
+        const std::vector<uint8_t> *pins ){
+        setIoType(INP);
         this->pin_in_buff_ena = pin_in_buff_ena;
         this->pins = pins;
-        enable();
     }
 
     retCode_t enable(){
@@ -269,37 +212,42 @@ class I_group: public IoGroup {
         return RET_OK;
     }
 
+    // filtered (debounced) input state
     bool isPinHigh(int pin_num){
         if(pin_num >= pins->size()){
             ALOGE("Pin {} is out of range", pin_num);
             return false;
         }
-        return digitalRead((*pins)[pin_num]);
+        return (filter.get() >> pin_num) & 0x01;
     }
 
     uint16_t get_bits(){
-      uint16_t res = 0x00;
-      for (int iInput = 0; iInput < pins->size(); iInput++){
-        if (isPinHigh(iInput)){
-          res |= (uint16_t)0x01<<iInput;
-        }
-      }
-      return res;
+      return filter.get();
     }
 
-    void resetOutputs(){};
+    // raw pin levels, as seen on the GPIOs
+    uint16_t read_raw_bits(){
+      return readInputSnapshot();
+    }
 
-    void ioOperation(DynamicJsonDocument& jsonRef){
-      std::string parameter = jsonRef["parameter"].as<std::string>();
-      std::string value = jsonRef["value"].as<std::string>();
-      if (parameter == "bits"){
-        appendJsonStatus(jsonRef, true, "Read ok");
+    void ioOperation(const apiCommand_t& cmd, JsonDocument& jsonRef){
+      switch (cmd.selector){
+      case API_SEL_BITS:
         jsonRef["bits"] = get_bits();
-        return;
-      } else {
-        appendJsonStatus(jsonRef, false, "ERR: invalid parameter");
-        return;
+        break;
+      case API_SEL_RAW:
+        jsonRef["bits"] = read_raw_bits();
+        break;
+      default: {
+        if (cmd.op == API_OP_RESET){
+          capture.resetStats();
+        }
+        JsonObject captureJson = jsonRef.createNestedObject("capture");
+        capture.getStats(captureJson);
+        break;
       }
+      }
+      appendJsonStatus(jsonRef, true, "Read ok");
     }
 
     void getState(JsonObject& jsonRef){
@@ -310,6 +258,13 @@ class I_group: public IoGroup {
       return;
     }
 
+    void startCapture(TaskHandle_t consumerTask){
+      capture.begin(pins, consumerTask);
+    }
+
+    InputCapture capture;
+    InputFilter filter;
+
 private:
     int pin_in_buff_ena;
     const std::vector<uint8_t> *pins;
@@ -321,23 +276,55 @@ class ButtonHandler;
 class IoController {
 
 public:
-    IoController() : buttonHandler(this) {};
+    IoController() :
+      inputs(PIN_IN_BUFF_ENA, &input_pins),
+      buttonHandler(this) {};
     void begin(TwoWire &wire){
       _wire = &wire;
       init_controller_objects();
+      ConfigStore.attachPublishHook(publishConfig, this);
       spawnWatchdogTask();
     }
-    DynamicJsonDocument handleApiCall(std::vector<std::string>& api_call);
+    void handleApiCall(const apiCommand_t& cmd, JsonDocument& retJson);
+    void handleBatch(const apiCommand_t* cmds, int count, JsonDocument& retJson);
     void setOutput(antControllerIoType_t ioType, int pin_num, bool val);
+
+    outputTransaction_t beginTransaction();
+    bool stageOutput(outputTransaction_t& tx, antControllerIoType_t ioType, int pin_num, bool val);
+    bool commitTransaction(outputTransaction_t& tx, i2cLane_t lane = I2C_LANE_API);
+    bool commitBreakMake(outputTransaction_t& breakTx, outputTransaction_t& makeTx);
+    void getOutputWords(uint16_t words[EXP_COUNT]);
+    static void applyTransaction(const outputTransaction_t& tx, uint16_t words[EXP_COUNT]);
     bool getIoValue(antControllerIoType_t ioType, int pin_num);
     uint16_t getGroupBits(antControllerIoType_t ioType);
 
-    DynamicJsonDocument getIoControllerState();
-    DynamicJsonDocument returnApiUnavailable(DynamicJsonDocument& jsonRef);
+    void getIoControllerState(JsonDocument& retJson);
+    // isFull - in: build the whole state anyway, out: the whole state
+    // was built. Nothing is marked as sent until commitStateDelta().
+    bool getStateDelta(JsonDocument& retJson, bool* isFull);
+    void commitStateDelta();
+    uint32_t getStateSeq();
+    void markStateDirty(uint32_t ioMask, uint32_t groupMask = 0);
+    void holdStateUpdates(bool shouldHold);
+    void returnApiUnavailable(JsonDocument& retJson);
+
+    void resyncExpanders(JsonDocument& retJson, bool verifyOnly);
+    // A guard reset or safe state write failed - the expanders it
+    // missed stay diverged, retried by resyncSafetyWrites().
+    void recordSafetyWriteFailure(const char* what);
+    bool resyncSafetyWrites();
+    void postSafetyResync();
+
+    binStatus_t handleBinaryFrame(const uint8_t* data, size_t len, binStateFrame_t& reply);
+    void getStateFrame(binStateFrame_t& frame);
 
     void setLocked(bool shouldLock);
     void setPanic(bool shouldPanic);
 
+    void handleInputBits(uint16_t bits, uint32_t edgeUs);
+    void postInputBits(uint16_t bits, uint32_t edgeUs);
+    void applyLatestInputBits();
+    void applyInputFilters(const Config_& config);
     void notifyOnBitsChange(uint16_t bits);
     void attachNotifyTaskHandle(TaskHandle_t taskHandle);
     void notifyAttachedTask();
@@ -346,18 +333,56 @@ public:
     bool locked;
     bool inPanic = false;
     TaskHandle_t notifyTaskHandle = NULL;
+    TaskHandle_t watchdogTaskHandle = NULL;
+    I_group inputs;
 
 private:
     TwoWire* _wire;
-    PCA9555 expanders[EXP_COUNT];
+    ShadowExpander expanders[EXP_COUNT];
 
-    std::vector<IoGroup*> ioGroups;
+    // indexed by antControllerIoType_t
+    O_group outputs[OUTPUT_GROUP_COUNT];
     ButtonHandler buttonHandler;
 
     retCode_t init_controller_objects();
-    retCode_t init_expander(PCA9555* p_exp, int addr);
 
     void setDefaultState();
+    static bool safeStateJob(void* p_ioController);
+    static bool commitJob(void* p_commit);
+    static bool resyncJob(void* p_resync);
+    bool commitPhases(outputTransaction_t* txs, int phases, i2cLane_t lane);
+    void applyConfig(std::shared_ptr<Config_> next);
+    static bool configSwapJob(void* p_swap);
+    static void publishConfig(std::shared_ptr<Config_> next, void* p_ioController);
+    void getSafetyStats(JsonDocument& retJson, bool reset);
+    void markOutputsDirty(const uint16_t before[EXP_COUNT]);
+    binStatus_t applyWriteFrame(const uint8_t* data, size_t len);
+
+    // bumped on every state change, sent as the event id
+    std::atomic<uint32_t> stateSeq{1};
+    std::atomic<uint32_t> dirtyIo{0};
+    std::atomic<uint32_t> dirtyGroups{0};
+    // changes are not published while non-zero, see holdStateUpdates()
+    std::atomic<int> stateHold{0};
+    uint32_t stateGeneration = 0;
+    // what the last getStateDelta() covered
+    uint32_t deltaIo = 0;
+    uint32_t deltaGroups = 0;
+    uint32_t deltaGeneration = 0;
+
+    // filtered inputs, published by the watchdog task,
+    // applied on the controller task
+    std::atomic<uint16_t> latestInputBits{0};
+    std::atomic<bool> inputJobQueued{false};
+    std::atomic<bool> panicSeen{false};
+    // timestamp of the edge behind the latest lock/panic change
+    std::atomic<uint32_t> safetyEdgeUs{0};
+
+    LatencyHistogram panicLatency{SAFETY_REACTION_BOUND_US};
+    LatencyHistogram lockLatency{SAFETY_REACTION_BOUND_US};
+    std::atomic<uint32_t> safetyWriteFailures{0};
+    // set on a failed safety write, cleared once a resync succeeds
+    std::atomic<bool> safetyResyncPending{false};
 };
 
 #endif // IO_CONTROLLER_H
\ No newline at end of file
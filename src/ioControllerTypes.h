@@ -1,12 +1,15 @@
 #ifndef IO_CONTROLLER_TYPES_H
 #define IO_CONTROLLER_TYPES_H
 
+#include <algorithm>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 
 #include <fmt/core.h>
-#include <PCA95x5.h>
+
+#include "inputFilter.h"
 
 typedef enum {
     RET_OK = 0,
@@ -20,12 +23,20 @@ typedef enum {
     EXP_COUNT
 } expIndex_t;
 
+// output changes staged for a single commit,
+// which results in at most one register write per expander
 typedef struct {
-    PCA9555* p_exp;
-    int out_num;
-    int out_offs;
-} outputGroup_t;
-
+    uint16_t mask[EXP_COUNT];
+    uint16_t bits[EXP_COUNT];
+} outputTransaction_t;
+
+// stages precomputed changes on top of tx, later changes win
+inline void stageTransaction(outputTransaction_t& tx, const outputTransaction_t& changes){
+    for (int i = 0; i < EXP_COUNT; i++){
+        tx.mask[i] |= changes.mask[i];
+        tx.bits[i] = (tx.bits[i] & ~changes.mask[i]) | (changes.bits[i] & changes.mask[i]);
+    }
+}
 
 typedef enum {
     MOSFET = 0,
@@ -36,7 +47,12 @@ typedef enum {
     OUT_TYPE_COUNT
 } antControllerIoType_t;
 
-bool isOutputType(antControllerIoType_t ioType);
+constexpr bool isOutputType(antControllerIoType_t ioType){
+    return ioType == MOSFET ||
+           ioType == RELAY ||
+           ioType == OPTO ||
+           ioType == TTL;
+}
 
 
 const std::map<antControllerIoType_t, const char*> ioTypeMap = {
@@ -47,10 +63,20 @@ const std::map<antControllerIoType_t, const char*> ioTypeMap = {
     {INP, "INP"}
 };
 
+// returns OUT_TYPE_COUNT if the tag is not known
+inline antControllerIoType_t ioTypeFromTag(std::string_view tag){
+    for (auto& [ioType, ioTag]: ioTypeMap){
+        if (tag == ioTag){
+            return ioType;
+        }
+    }
+    return OUT_TYPE_COUNT;
+}
+
 
 typedef struct {
     bool onHigh;
-    std::string guardedButton;
+    uint16_t buttonId; // index in Config_::buttons
 } pinGuard_t;
 
 class pin_t{
@@ -63,27 +89,24 @@ public:
     antControllerIoType_t ioType;
     int ioNum;
 
+    // input filtering, only used by INP pins
+    inputFilterMode_t filterMode = FILTER_DEBOUNCE;
+    int assertMs = 0;
+    int deassertMs = 0;
+
     bool operator==(const pin_t& other) const {
         return name == other.name;
     }
 
     std::string to_string() const{
-        std::string ret = fmt::format("{}: {}[{}] ({})",
+        return fmt::format("{}: {}[{}] ({})",
             name, ioTypeMap.at(ioType), ioNum, sch);
-        
-        if (pinGuards.size() > 0){
-            ret += " - guards buttons: ";
-            for (auto& g : pinGuards){
-                ret += fmt::format("('{}'@{})", g.guardedButton,g.onHigh ? "high" : "low" );
-            }
-        }        
-        return ret;
     }
 
-    void setGuard(std::string buttonName, bool onHigh){
+    void setGuard(uint16_t buttonId, bool onHigh){
         pinGuard_t guard;
         guard.onHigh = onHigh;
-        guard.guardedButton = buttonName;
+        guard.buttonId = buttonId;
         pinGuards.push_back(guard);
     }
 
@@ -138,45 +161,114 @@ public:
 
         ioNum -= 1; //translate schematic numbers to code numbers
     }    
+
+    // already resolved, see configImage.h
+    pin_t (
+        const std::string& name,
+        const std::string& sch,
+        antControllerIoType_t ioType,
+        int ioNum
+    ){
+        this->name = name;
+        this->sch = sch;
+        this->ioType = ioType;
+        this->ioNum = ioNum;
+    }
 };
 
+// pin guards as bitmasks - expander registers, followed by the INP word
+const int GUARD_PORT_INP = EXP_COUNT;
+const int GUARD_PORT_COUNT = EXP_COUNT + 1;
+
+typedef struct {
+    uint16_t high[GUARD_PORT_COUNT]; // button is disabled when any is high
+    uint16_t low[GUARD_PORT_COUNT];  // button is disabled when any is low
+} guardMask_t;
+
+inline bool isGuardViolated(const guardMask_t& guard, const uint16_t ports[GUARD_PORT_COUNT]){
+    uint16_t hit = 0;
+    for (int i = 0; i < GUARD_PORT_COUNT; i++){
+        hit |= (ports[i] & guard.high[i]) | (~ports[i] & guard.low[i]);
+    }
+    return hit != 0;
+}
+
+const int BUTTON_NONE = -1;
+const int MAX_BUTTON_GROUPS = 32;
+
 class button_t {
 public:
     std::string name;
-    std::vector<std::string> pinNames;
+    uint16_t id;
+    uint16_t groupId;
+    std::vector<uint16_t> pinIds; // unique, index in Config_::pins
+    outputTransaction_t outputs = {}; // pins of the button turned on
+
+    // compiled by Config_::compileGuards()
+    guardMask_t guardMask = {};
 
     button_t() = delete;
 
-    button_t(
-        const std::string& name,
-        const std::vector<std::string>& pinNames
-    ){
+    button_t(const std::string& name, uint16_t id, uint16_t groupId){
         this->name = name;
-        this->pinNames = pinNames;
-    }
-
-    std::string to_string(){
-        std::string ret = name + ": [";
-        for(const auto& p : pinNames){
-            ret += p + " ";
-        }
-        ret += "]";
-        return ret;
+        this->id = id;
+        this->groupId = groupId;
     }
 };
 
 typedef struct {
     std::string name;
-    std::vector<button_t> buttons;
+    std::vector<uint16_t> buttonIds;
+    outputTransaction_t reset = {}; // pins of all buttons turned off
+} buttonGroup_t;
+
+// Button changes staged together, see ButtonHandler::planButton().
+// Committed as a "break" and a "make" transaction.
+typedef struct {
+    outputTransaction_t breakTx;
+    outputTransaction_t makeTx;
+    uint32_t groups; // bit per group changed by the plan
+    int16_t activeButtons[MAX_BUTTON_GROUPS]; // valid for groups in "groups"
+} buttonPlan_t;
+
+// Sorted name -> id table. Only used to resolve names at config load
+// and at the API boundary, everything else refers to IDs.
+class nameIndex_t {
+public:
+    void clear(){
+        entries.clear();
+    }
+
+    void add(const std::string& name, uint16_t id){
+        entries.push_back(std::make_pair(name, id));
+    }
 
-    std::string to_string(){
-        std::string ret = name + ": \n";
-        for(auto& b : buttons){
-            ret += b.to_string() + "\n";
+    // on duplicate names the lowest id wins
+    void build(){
+        std::sort(entries.begin(), entries.end());
+    }
+
+    int find(std::string_view name) const {
+        auto it = std::lower_bound(entries.begin(), entries.end(), name,
+            [](const std::pair<std::string, uint16_t>& e, std::string_view n){
+                return e.first < n;
+            });
+        if ((it == entries.end()) || (it->first != name)){
+            return -1;
         }
-        return ret;
+        return it->second;
     }
-    std::string currentButtonName = "OFF";
-} buttonGroup_t;
+
+private:
+    std::vector<std::pair<std::string, uint16_t>> entries;
+};
+
+// pin guard compiled for a single INP bit
+typedef struct {
+    uint16_t buttonId; // index in Config_::buttons
+    bool onHigh;
+} inputGuard_t;
+
+const int INPUT_GUARD_BITS = 16;
 
 #endif // IO_CONTROLLER_TYPES_H
\ No newline at end of file
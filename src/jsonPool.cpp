@@ -0,0 +1,42 @@
+#include "jsonPool.h"
+#include "alfalog.h"
+
+JsonPool_ &JsonPool = JsonPool.getInstance();
+
+void JsonPool_::begin(){
+    freeDocs = xQueueCreateStatic(JSON_POOL_SIZE, sizeof(JsonDocument*),
+        freeDocsStorage, &freeDocsBuffer);
+    for (auto& d: docs){
+        JsonDocument* doc = &d;
+        xQueueSend(freeDocs, &doc, 0);
+    }
+}
+
+JsonDocument* JsonPool_::acquire(int timeoutMs){
+    JsonDocument* doc = NULL;
+    if ((freeDocs == NULL) ||
+        (xQueueReceive(freeDocs, &doc, timeoutMs / portTICK_PERIOD_MS) != pdTRUE)){
+        exhausted++;
+        return NULL;
+    }
+    acquired++;
+    doc->clear();
+    return doc;
+}
+
+void JsonPool_::release(JsonDocument* doc){
+    if (doc->overflowed()){
+        overflowed++;
+        ALOGE("JSON document overflowed ({}b), reply not sent", doc->capacity());
+    }
+    xQueueSend(freeDocs, &doc, 0);
+}
+
+void JsonPool_::getStats(JsonObject& jsonRef){
+    jsonRef["size"] = JSON_POOL_SIZE;
+    jsonRef["capacity"] = API_JSON_CAPACITY;
+    jsonRef["free"] = uxQueueMessagesWaiting(freeDocs);
+    jsonRef["acquired"] = acquired;
+    jsonRef["exhausted"] = exhausted;
+    jsonRef["overflowed"] = overflowed;
+}
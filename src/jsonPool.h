@@ -0,0 +1,95 @@
+#ifndef JSON_POOL_H
+#define JSON_POOL_H
+
+#include <Arduino.h>
+#undef B1
+#include "ArduinoJson.h"
+
+#include "ioControllerTypes.h"
+
+// Every API response and state event is built in one of a few
+// statically allocated documents, instead of a heap-allocated
+// DynamicJsonDocument per call.
+
+// full state (/api/INF) of the largest possible config - keys and
+// group/button names are not copied into the document (linked strings)
+constexpr size_t stateJsonSize(size_t groupCount){
+    return JSON_OBJECT_SIZE(7) +                   // io, buttons, locked, panic, seq, msg, retCode
+        JSON_OBJECT_SIZE(OUT_TYPE_COUNT) +         // io
+        OUT_TYPE_COUNT * JSON_OBJECT_SIZE(3) +     // type, bits, ioNum
+        JSON_OBJECT_SIZE(1) +                      // buttons
+        JSON_OBJECT_SIZE(groupCount);              // groups
+}
+
+const size_t API_JSON_CAPACITY = 1536;
+const int JSON_POOL_SIZE = 4;
+const int JSON_POOL_TIMEOUT_MS = 100;
+
+static_assert(stateJsonSize(MAX_BUTTON_GROUPS) <= API_JSON_CAPACITY,
+    "API_JSON_CAPACITY too small for the state of MAX_BUTTON_GROUPS groups");
+
+// The above only covers the document - replies are serialized into
+// API_JSON_CAPACITY byte buffers as well, null terminated. Serialized
+// /api/INF without the button groups, with the longest values (bits
+// 65535, seq 4294967295, "false") - group names and button names are
+// checked at config load, see Config_::stateJsonLength().
+const size_t STATE_JSON_BASE_LENGTH = 342;
+
+typedef StaticJsonDocument<API_JSON_CAPACITY> apiJson_t;
+
+class JsonPool_ {
+public:
+    JsonPool_() = default;
+
+    static JsonPool_ &getInstance(){
+        static JsonPool_ instance;
+        return instance;
+    }
+
+    void begin();
+
+    // returns NULL if every document is in use for timeoutMs
+    JsonDocument* acquire(int timeoutMs = JSON_POOL_TIMEOUT_MS);
+    void release(JsonDocument* doc);
+
+    void getStats(JsonObject& jsonRef);
+
+private:
+    apiJson_t docs[JSON_POOL_SIZE];
+    QueueHandle_t freeDocs = NULL;
+    StaticQueue_t freeDocsBuffer;
+    uint8_t freeDocsStorage[JSON_POOL_SIZE * sizeof(JsonDocument*)];
+
+    uint32_t acquired = 0;
+    uint32_t exhausted = 0;
+    uint32_t overflowed = 0;
+};
+
+extern JsonPool_ &JsonPool;
+
+// Document borrowed from the pool for the lifetime of the object.
+class PooledJson {
+public:
+    PooledJson(int timeoutMs = JSON_POOL_TIMEOUT_MS){
+        doc = JsonPool.acquire(timeoutMs);
+    }
+    ~PooledJson(){
+        if (doc != NULL){
+            JsonPool.release(doc);
+        }
+    }
+    PooledJson(const PooledJson&) = delete;
+    PooledJson& operator=(const PooledJson&) = delete;
+
+    bool isValid() const {
+        return doc != NULL;
+    }
+    JsonDocument& operator*(){
+        return *doc;
+    }
+
+private:
+    JsonDocument* doc = NULL;
+};
+
+#endif // JSON_POOL_H
@@ -0,0 +1,141 @@
+#include "laneWorker.h"
+#include "alfalog.h"
+
+bool LaneWorker::start(uint32_t stackDepth, UBaseType_t priority, BaseType_t core){
+    for (int i = 0; i < laneCount; i++){
+        lanes[i] = xQueueCreate(LANE_WORKER_DEPTH, sizeof(laneJob_t));
+    }
+    BaseType_t taskCreated = xTaskCreatePinnedToCore( LaneWorkerTask, name,
+        stackDepth, this, priority, &ownerTask, core );
+    if (taskCreated != pdPASS){
+        ownerTask = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool LaneWorker::isOwnerContext(){
+    // before the task starts (during setup) the caller is the owner
+    return (ownerTask == NULL) ||
+        (xTaskGetCurrentTaskHandle() == ownerTask);
+}
+
+bool LaneWorker::enqueue(int lane, laneJob_t& job){
+    job.enqueuedUs = micros();
+    if (xQueueSend(lanes[lane], &job, 0) != pdTRUE){
+        stats[lane].dropped++;
+        ALOGE("{} {} lane full, job dropped", name, laneNames[lane]);
+        return false;
+    }
+    uint32_t depth = uxQueueMessagesWaiting(lanes[lane]);
+    if (depth > stats[lane].maxDepth){
+        stats[lane].maxDepth = depth;
+    }
+    xTaskNotifyGive(ownerTask);
+    return true;
+}
+
+bool LaneWorker::run(int lane, laneJobFn_t fn, void* arg){
+    if (isOwnerContext()){
+        return fn(arg);
+    }
+
+    bool result = false;
+    StaticSemaphore_t doneBuffer;
+    laneJob_t job = {};
+    job.fn = fn;
+    job.arg = arg;
+    job.result = &result;
+    job.done = xSemaphoreCreateBinaryStatic(&doneBuffer);
+
+    if (!enqueue(lane, job)){
+        return false;
+    }
+    // job refers to this stack frame, so it must not time out
+    xSemaphoreTake(job.done, portMAX_DELAY);
+    return result;
+}
+
+bool LaneWorker::post(int lane, laneJobFn_t fn, void* arg){
+    if (isOwnerContext()){
+        return fn(arg);
+    }
+
+    laneJob_t job = {};
+    job.fn = fn;
+    job.arg = arg;
+    return enqueue(lane, job);
+}
+
+bool LaneWorker::popNextJob(laneJob_t* job, int* lane){
+    for (int i = 0; i < laneCount; i++){
+        if (xQueueReceive(lanes[i], job, 0) == pdTRUE){
+            *lane = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void LaneWorker::execute(int lane, laneJob_t& job){
+    uint32_t startUs = micros();
+    bool result = job.fn(job.arg);
+    uint32_t endUs = micros();
+
+    laneStats_t& s = stats[lane];
+    uint32_t waitUs = startUs - job.enqueuedUs;
+    s.jobs++;
+    s.totalWaitUs += waitUs;
+    if (waitUs > s.maxWaitUs){
+        s.maxWaitUs = waitUs;
+    }
+    if (endUs - startUs > s.maxExecUs){
+        s.maxExecUs = endUs - startUs;
+    }
+
+    if (job.result != NULL){
+        *job.result = result;
+    }
+    if (job.done != NULL){
+        xSemaphoreGive(job.done);
+    }
+}
+
+void LaneWorker::getStats(JsonObject& jsonRef){
+    for (int i = 0; i < laneCount; i++){
+        const laneStats_t& s = stats[i];
+        JsonObject laneJson = jsonRef.createNestedObject(laneNames[i]);
+        laneJson["depth"] = (lanes[i] != NULL) ? uxQueueMessagesWaiting(lanes[i]) : 0;
+        laneJson["maxDepth"] = s.maxDepth;
+        laneJson["jobs"] = s.jobs;
+        laneJson["dropped"] = s.dropped;
+        laneJson["avgWaitUs"] = (s.jobs > 0) ? (uint32_t)(s.totalWaitUs / s.jobs) : 0;
+        laneJson["maxWaitUs"] = s.maxWaitUs;
+        laneJson["maxExecUs"] = s.maxExecUs;
+    }
+}
+
+void LaneWorker::resetStats(){
+    for (auto& s: stats){
+        s = {};
+    }
+}
+
+bool LaneWorker::runPending(){
+    laneJob_t job;
+    int lane;
+    bool anyJob = false;
+    while (popNextJob(&job, &lane)){
+        execute(lane, job);
+        anyJob = true;
+    }
+    return anyJob;
+}
+
+void LaneWorkerTask(void *parameter){
+    LaneWorker* worker = (LaneWorker*)parameter;
+    for (;;){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        worker->runPending();
+    }
+}
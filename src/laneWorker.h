@@ -0,0 +1,72 @@
+#ifndef LANE_WORKER_H
+#define LANE_WORKER_H
+
+#include <Arduino.h>
+#undef B1
+#include "ArduinoJson.h"
+
+typedef bool (*laneJobFn_t)(void* arg);
+
+typedef struct {
+    laneJobFn_t fn;
+    void* arg;
+    bool* result;
+    SemaphoreHandle_t done; // NULL for fire-and-forget jobs
+    uint32_t enqueuedUs;
+} laneJob_t;
+
+typedef struct {
+    uint32_t jobs;
+    uint32_t dropped;
+    uint32_t maxDepth;
+    uint32_t maxWaitUs;
+    uint64_t totalWaitUs;
+    uint32_t maxExecUs;
+} laneStats_t;
+
+const int LANE_WORKER_MAX_LANES = 4;
+const int LANE_WORKER_DEPTH = 8;
+
+void LaneWorkerTask(void *parameter);
+
+// Owner task with priority lanes - jobs are executed one at a time, and
+// a pending job from a lower lane is only started, when all the higher
+// lanes are empty. Lane 0 is the most urgent one.
+class LaneWorker {
+public:
+    LaneWorker(const char* name, const char* const* laneNames, int laneCount):
+        name(name), laneNames(laneNames), laneCount(laneCount) {}
+
+    // execute a job on the owner task and wait for its completion
+    bool run(int lane, laneJobFn_t fn, void* arg);
+    // enqueue a job and return immediately
+    bool post(int lane, laneJobFn_t fn, void* arg);
+    // executes the queued jobs, lanes are re-checked from the top after
+    // every job. Returns false if none were queued. Called by the owner
+    // task (or a host test, acting as one).
+    bool runPending();
+
+    void getStats(JsonObject& jsonRef);
+    void resetStats();
+
+protected:
+    // false if the task couldn't be created - jobs then run in the
+    // caller's context, like before start()
+    bool start(uint32_t stackDepth, UBaseType_t priority, BaseType_t core);
+    bool isOwnerContext();
+
+private:
+    bool enqueue(int lane, laneJob_t& job);
+    bool popNextJob(laneJob_t* job, int* lane);
+    void execute(int lane, laneJob_t& job);
+
+    const char* name;
+    const char* const* laneNames;
+    int laneCount;
+
+    QueueHandle_t lanes[LANE_WORKER_MAX_LANES] = {};
+    laneStats_t stats[LANE_WORKER_MAX_LANES] = {};
+    TaskHandle_t ownerTask = NULL;
+};
+
+#endif // LANE_WORKER_H
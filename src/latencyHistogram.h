@@ -0,0 +1,99 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include "ArduinoJson.h"
+
+// Fixed log2 buckets, no allocation - bucket 0 is below
+// 2^BUCKET0_LOG2, bucket i covers [2^(BUCKET0_LOG2+i-1), 2^(BUCKET0_LOG2+i)),
+// the last one collects everything above.
+// Not thread-safe, recorded and read by a single task.
+template <int BUCKETS, int BUCKET0_LOG2>
+class Log2Histogram {
+public:
+    static constexpr int BUCKET_COUNT = BUCKETS;
+
+    // values above bound are counted as overBound
+    explicit Log2Histogram(uint32_t bound = UINT32_MAX) : bound(bound) {}
+
+    static int bucketOf(uint32_t value){
+        if (value == 0){
+            return 0;
+        }
+        int bucket = (31 - __builtin_clz(value)) - BUCKET0_LOG2 + 1;
+        if (bucket < 0){
+            return 0;
+        }
+        return (bucket < BUCKETS) ? bucket : BUCKETS - 1;
+    }
+
+    // exclusive upper limit of a bucket, 0 for the last one
+    static uint32_t bucketLimit(int bucket){
+        return (bucket < BUCKETS - 1) ?
+            (uint32_t)0x01 << (BUCKET0_LOG2 + bucket) : 0;
+    }
+
+    void record(uint32_t value){
+        if (value < min){
+            min = value;
+        }
+        if (value > max){
+            max = value;
+        }
+        if (value > bound){
+            overBound++;
+        }
+        total += value;
+        count++;
+        buckets[bucketOf(value)]++;
+    }
+
+    void reset(){
+        *this = Log2Histogram(bound);
+    }
+
+    uint32_t getCount() const { return count; }
+    uint32_t getMin() const { return (count > 0) ? min : 0; }
+    uint32_t getAvg() const { return (count > 0) ? (uint32_t)(total / count) : 0; }
+    uint32_t getMax() const { return max; }
+    uint32_t getOverBound() const { return overBound; }
+    uint32_t getBucket(int bucket) const { return buckets[bucket]; }
+
+    // min/avg/max are divided by perUs, e.g. the CPU clock in MHz
+    // for values in cycles
+    void getSummary(JsonObject& jsonRef, uint32_t perUs = 1) const {
+        jsonRef["count"] = count;
+        jsonRef["minUs"] = getMin() / perUs;
+        jsonRef["avgUs"] = getAvg() / perUs;
+        jsonRef["maxUs"] = max / perUs;
+        if (bound != UINT32_MAX){
+            jsonRef["overBound"] = overBound;
+        }
+    }
+
+    // summary and raw bucket counts
+    void getStats(JsonObject& jsonRef, uint32_t perUs = 1) const {
+        getSummary(jsonRef, perUs);
+        JsonArray bucketsJson = jsonRef.createNestedArray("buckets");
+        for (auto b: buckets){
+            bucketsJson.add(b);
+        }
+    }
+
+private:
+    uint32_t bound;
+    uint32_t count = 0;
+    uint32_t min = UINT32_MAX;
+    uint32_t max = 0;
+    uint64_t total = 0;
+    uint32_t overBound = 0;
+    uint32_t buckets[BUCKETS] = {};
+};
+
+// Panic/lock reaction times in us - bucket 0 is below 64us,
+// the last one starts at 262ms.
+const int LATENCY_BUCKETS = 14;
+const int LATENCY_BUCKET0_LOG2 = 6;
+typedef Log2Histogram<LATENCY_BUCKETS, LATENCY_BUCKET0_LOG2> LatencyHistogram;
+
+#endif // LATENCY_HISTOGRAM_H
@@ -1,6 +1,8 @@
 // Ant controller firmware
 // (C) cr1tbit 2023
 
+#include <atomic>
+#include <charconv>
 #include <fmt/ranges.h>
 
 #include <Wire.h>
@@ -19,6 +21,14 @@
 #include "antControllerHelpers.h"
 
 #include "ioController.h"
+#include "i2cBus.h"
+#include "jsonPool.h"
+#include "binaryFrame.h"
+#include "apiCommand.h"
+#include "controllerTask.h"
+#include "builtinConfig.h"
+#include "allocTracker.h"
+#include "traceSpan.h"
 #include "main.h"
 #include "configHandler.h"
 
@@ -26,24 +36,28 @@
 #include "clitussiStub.h"
 
 const char CONFIG_FILE[] = "/buttons.conf";
-const char CONFIG_FALLBACK[] = "/buttons_simple.conf";
+
+const size_t BATCH_MAX_BODY = 1024;
+static_assert(BATCH_MAX_BODY <= CTRL_CALL_BUFFER, "batch body must fit in a call");
+static_assert(BIN_MAX_WRITE_FRAME <= CTRL_CALL_BUFFER, "binary frame must fit in a call");
+static_assert(sizeof(binStateFrame_t) <= CTRL_CALL_BUFFER, "binary reply must fit in a call");
+
+const char SERVER_BUSY_JSON[] = "{\"msg\":\"ERR: server busy\",\"retCode\":503}";
+const char REPLY_TOO_LONG_JSON[] = "{\"msg\":\"ERR: reply too long\",\"retCode\":500}";
 
 AsyncWebServer server(80);
 AsyncEventSource events("/events");
 
 IoController ioController;
 
-bool shouldPostSocketUpdate = false;
-
 clitussiStub clitussi;
 
-SemaphoreHandle_t apiCallSemaphore;
+// set when a new events client needs a full snapshot
+static std::atomic<bool> fullStateRequested{false};
 
-DynamicJsonDocument getErrorJson(const std::string& msg){
-    DynamicJsonDocument json(1024);
+void getErrorJson(JsonDocument& json, const std::string& msg){
     json["msg"] = msg;
     json["retCode"] = 500;
-    return json;
 }
 /* JSON schema:
  * {
@@ -68,32 +82,247 @@ bool spurt(const String& fn, const std::string& content) {
     return w == content.length();
 }
 
-DynamicJsonDocument mainHandleApiCall(const std::string &subpath, int* ret_code, apiSource_t source = API_SOURCE_HTTP){
-    ALOGD("Analyzing subpath: '{}'", subpath.c_str());
+// Everything below, up to the call jobs, runs on the controller task.
+// Result is written to json, usually borrowed from JsonPool.
+void mainHandleApiCall(JsonDocument& json, std::string_view subpath, apiSource_t source = API_SOURCE_HTTP){
+    ALOGD("Analyzing subpath: '{}'", subpath);
     //schema is <CMD>/<INDEX>/<VALUE>
-    *ret_code = 200;
+    TraceSpan span(SPAN_API_CALL);
+
+    // parsing and the button path must not touch the heap
+    AllocScope allocScope;
+    apiCommand_t cmd;
+    parseApiCommand(subpath, cmd);
+    ioController.handleApiCall(cmd, json);
+#ifdef ALLOC_TRACKING
+    json["allocs"] = allocScope.end();
+#endif
+}
 
-    auto api_split = splitString(subpath, '/');
+// Commands separated by newlines or ';', e.g. "BUT/a/A1;REL/1/on"
+void mainHandleBatch(JsonDocument& json, std::string_view body){
+    // only used by the controller task
+    static apiCommand_t commands[BATCH_MAX_COMMANDS];
 
-    if (api_split.size() == 0){
-        return getErrorJson("invnalid API call: " + subpath);
-    }
+    int count = parseApiBatch(body, commands, BATCH_MAX_COMMANDS);
+    ioController.handleBatch(commands, count, json);
+}
+
+typedef void (*jsonCallHandler_t)(JsonDocument& json, std::string_view request);
+
+static void setCallReply(ctrlCall_t* call, int code, const char* reply){
+    call->code = code;
+    call->len = strlen(reply);
+    memcpy(call->buf, reply, call->len);
+}
 
-    if( apiCallSemaphore == NULL ) {
-        *ret_code = 500;
-        return getErrorJson("API call mutex does not exist.");
+// serializeJson() silently truncates the output, and a full document
+// silently drops fields - either is an error, not an invalid reply
+static bool fitsBuffer(JsonDocument& json, size_t bufferSize){
+    return !json.overflowed() && (measureJson(json) < bufferSize);
+}
+
+static bool fitsReply(JsonDocument& json, size_t bufferSize){
+    if (!fitsBuffer(json, bufferSize)){
+        ALOGE("Reply too long ({}b), not sent", measureJson(json));
+        return false;
     }
-    if( xSemaphoreTake(apiCallSemaphore, (TickType_t)100) == pdTRUE) {
-        DynamicJsonDocument json = ioController.handleApiCall(api_split);
-        shouldPostSocketUpdate = true;
-        xSemaphoreGive(apiCallSemaphore);
-        return json;
+    return true;
+}
+
+// Call jobs - the request is read from call->buf, which is then
+// overwritten with the reply. Used by both HTTP and serial.
+static void completeJsonCall(ctrlCall_t* call, jsonCallHandler_t handler){
+    PooledJson json;
+    if (!json.isValid()){
+        setCallReply(call, 503, SERVER_BUSY_JSON);
     } else {
-        *ret_code = 500;
-        return getErrorJson("Timeout waiting for API call mutex.");
+        handler(*json, std::string_view(call->buf, call->len));
+        if (fitsReply(*json, sizeof(call->buf))){
+            call->len = serializeJson(*json, call->buf, sizeof(call->buf));
+        } else {
+            setCallReply(call, 500, REPLY_TOO_LONG_JSON);
+        }
+    }
+    ControllerTask.completeCall(call);
+}
+
+static bool apiCallJob(void* arg){
+    completeJsonCall((ctrlCall_t*)arg, [](JsonDocument& json, std::string_view subpath){
+        mainHandleApiCall(json, subpath);
+    });
+    return true;
+}
+
+static bool batchCallJob(void* arg){
+    completeJsonCall((ctrlCall_t*)arg, mainHandleBatch);
+    return true;
+}
+
+static bool binaryCallJob(void* arg){
+    ctrlCall_t* call = (ctrlCall_t*)arg;
+    binStateFrame_t reply;
+    binStatus_t status = ioController.handleBinaryFrame(
+        (const uint8_t*)call->buf, call->len, reply);
+    call->code = (status == BIN_OK) ? 200 : ((status == BIN_ERR_LOCKED) ? 503 :
+        ((status == BIN_ERR_BUS) ? 500 : 400));
+    memcpy(call->buf, &reply, sizeof(reply));
+    call->len = sizeof(reply);
+    ControllerTask.completeCall(call);
+    return true;
+}
+
+// Runs a call job from a task that may block (serial, loop). The reply
+// is in call->buf, the call has to be released afterwards.
+ctrlCall_t* runCall(ctrlJobFn_t job, const void* request, size_t len){
+    if (len > CTRL_CALL_BUFFER){
+        ALOGE("Request too long");
+        return NULL;
+    }
+    ctrlCall_t* call = ControllerTask.acquireCall();
+    if (call == NULL){
+        ALOGE("No call available, controller busy");
+        return NULL;
+    }
+    memcpy(call->buf, request, len);
+    call->len = len;
+    ControllerTask.runCall(CTRL_LANE_API, job, call);
+    return call;
+}
+
+void sendServerBusy(AsyncWebServerRequest *request){
+    request->send(503, "application/json", SERVER_BUSY_JSON);
+}
+
+// Response of a queued call, it owns the call. The status and the
+// reply are only known once the controller task completes the call -
+// sendCallReply() waits for that, and if the call takes longer, the
+// response stays in RESPONSE_SETUP until the server polls it. The call
+// is released as soon as the reply is copied out.
+class AsyncCallResponse: public AsyncAbstractResponse {
+public:
+    AsyncCallResponse(ctrlCall_t* call, const char* contentType): call(call) {
+        _contentType = contentType;
+    }
+
+    ~AsyncCallResponse(){
+        release();
+    }
+
+    bool _sourceValid() const override {
+        return true;
+    }
+
+    void _respond(AsyncWebServerRequest *request) override {
+        if ((call != NULL) && ControllerTask.isCallDone(call)){
+            start(request);
+        }
+    }
+
+    size_t _ack(AsyncWebServerRequest *request, size_t len, uint32_t time) override {
+        if (_state == RESPONSE_SETUP){
+            _respond(request);
+            return 0;
+        }
+        return AsyncAbstractResponse::_ack(request, len, time);
+    }
+
+    size_t _fillBuffer(uint8_t *buf, size_t maxLen) override {
+        if (call == NULL){
+            return 0;
+        }
+        size_t len = std::min(maxLen, call->len - sent);
+        memcpy(buf, call->buf + sent, len);
+        sent += len;
+        if (sent == call->len){
+            release();
+        }
+        return len;
+    }
+
+private:
+    void start(AsyncWebServerRequest *request){
+        _code = call->code;
+        _contentLength = call->len;
+        if (call->len == 0){
+            release();
+        }
+        AsyncAbstractResponse::_respond(request);
+    }
+
+    // the slot may be handed out right after, so only once
+    void release(){
+        if (call != NULL){
+            ControllerTask.releaseCall(call);
+            call = NULL;
+        }
+    }
+
+    ctrlCall_t* call;
+    size_t sent = 0;
+};
+
+// Queues the call job, and replies once it's done - with the status
+// code set by the job. The async_tcp task waits up to CTRL_CALL_WAIT_MS,
+// so a reply goes out as soon as the call completes.
+void sendCallReply(AsyncWebServerRequest *request, ctrlCall_t* call,
+        ctrlJobFn_t job, const char* contentType, const char* etag = ""){
+    if (!ControllerTask.postCall(CTRL_LANE_API, job, call)){
+        ControllerTask.releaseCall(call);
+        sendServerBusy(request);
+        return;
+    }
+    ControllerTask.waitCall(call, CTRL_CALL_WAIT_MS);
+
+    AsyncWebServerResponse *response = new AsyncCallResponse(call, contentType);
+    if (etag[0] != '\0'){
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
+    }
+    request->send(response);
+}
+
+// copies the request into a call, and queues it
+void sendCall(AsyncWebServerRequest *request, ctrlJobFn_t job,
+        const void* data, size_t len, const char* contentType, const char* etag = ""){
+    if (len > CTRL_CALL_BUFFER){
+        request->send(400);
+        return;
+    }
+    ctrlCall_t* call = ControllerTask.acquireCall();
+    if (call == NULL){
+        sendServerBusy(request);
+        return;
+    }
+    memcpy(call->buf, data, len);
+    call->len = len;
+    sendCallReply(request, call, job, contentType, etag);
+}
+
+// Body handler - collects up to maxLen bytes in _tempObject, which
+// is freed by the server along with the request.
+void collectRequestBody(AsyncWebServerRequest *request, uint8_t *data,
+        size_t len, size_t index, size_t total, size_t maxLen){
+    if (total > maxLen){
+        return;
+    }
+    if (index == 0){
+        request->_tempObject = malloc(total);
+    }
+    if (request->_tempObject != NULL){
+        memcpy((uint8_t*)request->_tempObject + index, data, len);
     }
 }
 
+// serial commands are "<name> <args>", returns the args part
+std::string_view commandArgs(const std::string& cmd){
+    size_t pos = cmd.find(' ');
+    if (pos == std::string::npos){
+        return std::string_view();
+    }
+    return std::string_view(cmd).substr(pos + 1);
+}
+
 bool initializeLittleFS(){
     if(!LittleFS.begin(true)){
         // ALOGE("An Error has occurred while mounting SPIFFS");
@@ -111,26 +340,127 @@ bool initializeLittleFS(){
     }
 }
 
+// ETags are unique per boot - generation and sequence numbers restart
+// from 0, so a cached response from before a reboot must not match.
+static uint32_t etagBootId = 0;
+// bumped when the editor may have modified a file on LittleFS
+static std::atomic<uint32_t> configFileRevision{0};
+
+void getConfigEtag(char* buf, size_t len){
+    snprintf(buf, len, "\"c%08x-%u-%u\"", etagBootId,
+        ConfigStore.get()->generation, configFileRevision.load());
+}
+
+void getStateEtag(char* buf, size_t len, uint32_t seq){
+    snprintf(buf, len, "\"s%08x-%u-%u\"", etagBootId,
+        ConfigStore.get()->generation, seq);
+}
+
+bool etagMatches(AsyncWebServerRequest *request, const char* etag){
+    if (!request->hasHeader("If-None-Match")){
+        return false;
+    }
+    const String& tags = request->getHeader("If-None-Match")->value();
+    return (tags == "*") || (strstr(tags.c_str(), etag) != NULL);
+}
+
+void sendNotModified(AsyncWebServerRequest *request, const char* etag){
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    request->send(response);
+}
+
 void initializeHttpServer(){
     DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
     DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "content-type");
 
     server.on("/api/config", HTTP_GET, [](AsyncWebServerRequest *request){
+        char etag[32];
+        getConfigEtag(etag, sizeof(etag));
+        if (etagMatches(request, etag)){
+            sendNotModified(request, etag);
+            return;
+        }
         ALOGD("GET config");
-        request->send(LittleFS, Config.config_filename.c_str(), "text/plain", false);
+        configSnapshot_t config = ConfigStore.get();
+        AsyncWebServerResponse *response;
+        if (config->config_filename == builtin::NAME){
+            // the filesystem may be missing, the source is in flash
+            response = request->beginResponse_P(200, "text/plain",
+                (const uint8_t*)builtin::SOURCE, sizeof(builtin::SOURCE) - 1);
+        } else {
+            response = request->beginResponse(
+                LittleFS, config->config_filename.c_str(), "text/plain", false);
+        }
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
+        request->send(response);
     });
 
-    server.on("/api", HTTP_GET, [](AsyncWebServerRequest *request){
-        int ret_code = 418;
+    // registered before "/api", which would match it as well
+    server.on("/api/BIN", HTTP_GET, [](AsyncWebServerRequest *request){
+        sendCall(request, binaryCallJob, NULL, 0, "application/octet-stream");
+    });
+
+    server.on("/api/BIN", HTTP_POST, [](AsyncWebServerRequest *request){
+        if (request->_tempObject == NULL){
+            request->send(400);
+            return;
+        }
+        sendCall(request, binaryCallJob, request->_tempObject,
+            request->contentLength(), "application/octet-stream");
+    }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+        collectRequestBody(request, data, len, index, total, BIN_MAX_WRITE_FRAME);
+    });
+
+    // form-encoded bodies (curl -d) are parsed by the server into
+    // the "body" param, others are collected by the body handler
+    server.on("/api/batch", HTTP_POST, [](AsyncWebServerRequest *request){
+        std::string_view body;
+        if (request->_tempObject != NULL){
+            body = std::string_view((const char*)request->_tempObject, request->contentLength());
+        } else if (request->hasParam("body", true)){
+            const String& param = request->getParam("body", true)->value();
+            body = std::string_view(param.c_str(), param.length());
+        }
+        if ((body.length() == 0) || (body.length() > BATCH_MAX_BODY)){
+            request->send(400, "application/json",
+                "{\"msg\":\"ERR: empty or too long batch\",\"retCode\":400}");
+            return;
+        }
+        sendCall(request, batchCallJob, body.data(), body.length(), "application/json");
+    }, NULL, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+        collectRequestBody(request, data, len, index, total, BATCH_MAX_BODY);
+    });
 
-        std::string apiTrimmed = std::string(request->url().c_str()).substr(5);
-        DynamicJsonDocument api_result = mainHandleApiCall(apiTrimmed, &ret_code);
+    server.on("/api", HTTP_GET, [](AsyncWebServerRequest *request){
+        // strip "/api/"
+        std::string_view apiTrimmed(request->url().c_str());
+        apiTrimmed.remove_prefix(std::min<size_t>(5, apiTrimmed.length()));
+
+        // state polling - the sequence number is read before building
+        // the state, so the tag may only be older than the content
+        char etag[32] = "";
+        if (apiTrimmed == "INF"){
+            getStateEtag(etag, sizeof(etag), ioController.getStateSeq());
+            if (etagMatches(request, etag)){
+                sendNotModified(request, etag);
+                return;
+            }
+        }
 
-        ALOGD("API call result:\n{}\n",api_result.as<String>());
-        request->send(ret_code, "application/json", api_result.as<String>());
+        sendCall(request, apiCallJob, apiTrimmed.data(), apiTrimmed.length(),
+            "application/json", etag);
     });
 
-    server.addHandler(new SPIFFSEditor(LittleFS, "test","test"));
+    // uploads and deletes through the editor invalidate /api/config
+    server.addHandler(new SPIFFSEditor(LittleFS, "test","test")).setFilter(
+        [](AsyncWebServerRequest *request){
+            if ((request->method() != HTTP_GET) && (request->url() == "/edit")){
+                configFileRevision++;
+            }
+            return true;
+        });
 
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
         if (LittleFS.exists("/static/index.html")){
@@ -147,24 +477,31 @@ void initializeHttpServer(){
 
     server.serveStatic("/", LittleFS, "/static/");
 
+    // event ids are state sequence numbers - other events are sent
+    // with id 0, so they don't change the client's lastId()
     events.onConnect([](AsyncEventSourceClient *client){
         if(client->lastId()){
             ALOGD("Client reconnected! Last message ID that it had: {}\n", client->lastId());
         }
-        client->send("AntController connected",NULL,millis(),1000);
+        client->send("AntController connected",NULL,0,1000);
         events.send(
             fmt::format("{}{}{}", 
                 alogColorGrey, alogGetInitString(1), alogColorReset).c_str(),
-            "log", millis());
+            "log", 0);
         events.send(fmt::format("{}{}{}", 
                 alogColorGrey, alogGetInitString(2), alogColorReset).c_str(),
-            "log", millis());
+            "log", 0);
+
+        // full snapshot, unless the client has seen the latest state -
+        // built on the controller task, and sent to every client
+        if (client->lastId() != ioController.getStateSeq()){
+            fullStateRequested = true;
+            ioController.notifyAttachedTask();
+        }
         ALOGT("events connected");
-        shouldPostSocketUpdate = true;
     });
 
     server.addHandler(&events);
-    shouldPostSocketUpdate = true;
 
     server.begin();
 }
@@ -175,12 +512,20 @@ SerialLogger serialLogger = SerialLogger(
     LOG_DEBUG, ALOG_FANCY, ALOG_FILELINE
 );
 SerialLogger socketLogger = SerialLogger(
-    [](const char* str) { events.send(str,"log",millis());},
+    [](const char* str) { events.send(str,"log",0);},
     LOG_INFO, ALOG_FANCY, ALOG_NOFILELINE
 );
 AdvancedOledLogger aOledLogger = AdvancedOledLogger(
     i2c, LOG_INFO, OLED_128x64, OLED_NORMAL);
 
+// Loop task only. Not a bus job - a redraw is a whole frame, ~94ms at
+// 100kHz. Its transactions interleave with the bus jobs instead, so
+// a safety write only waits for a single page (see I2cBus_::begin()).
+static void oledRedraw(){
+    TraceSpan span(SPAN_OLED_REDRAW);
+    aOledLogger.redraw();
+}
+
 void setup(){
     // #ifdef WAIT_FOR_SERIAL
     //         delay(2000);
@@ -210,46 +555,53 @@ void setup(){
 
     ALOG_I2CLS(i2c);
 
+    I2cBus.begin();
+    JsonPool.begin();
+    ControllerTask.begin();
     ioController.begin(i2c);
     ioController.attachNotifyTaskHandle(xTaskGetCurrentTaskHandle());
     ALOGD("ioController start");
 
+    if (digitalRead(PIN_BUT4) == LOW){
+        ALOGI("Button 4 was pressed during launch - "
+            "the device will load a fallback config");
+        ConfigStore.loadBuiltin();
+    } else if (lastRestartFaulty()){
+        ALOGI("Last restart was faulty - loading fallback config");
+        ConfigStore.loadBuiltin();
+    }
+
     if (initializeLittleFS()){
         ALOGT("LittleFS init ok.");
-        static const char *config_filename = CONFIG_FILE;
-
-        if (digitalRead(PIN_BUT4) == LOW){
-            ALOGI("Button 4 was pressed during launch - "
-                "the device will load a fallback config");            
-            config_filename = CONFIG_FALLBACK; //todo hardcoded config complied in
-        } else if (lastRestartFaulty()){
-            ALOGI("Last restart was faulty - loading fallback config");
-            config_filename = CONFIG_FALLBACK;
-        }
         // spawn on another task because main arduino task
         // has hardcoded 8kb stack size
-        Config.trySpawnLoaderTask(config_filename);
+        if (!ConfigStore.get()->is_valid){
+            ConfigStore.load(CONFIG_FILE);
+        }
+    } else {
+        ALOGE("LittleFS init failed - loading fallback config");
+        ConfigStore.loadBuiltin();
     }
 
     vTaskDelay(3000 / portTICK_PERIOD_MS);
 
-    apiCallSemaphore = xSemaphoreCreateMutex();
     xTaskCreate( SerialTerminalTask, "serial task",
                 10000, NULL, 2, NULL );
     ALOGI("Connecting WiFi...");
     WiFiSettings.onWaitLoop = []() {
-        aOledLogger.redraw();
+        oledRedraw();
         return 100;
     };
     WiFiSettings.onPortal = []() {
         ALOGE("Couldn't connect to WiFi. "
         "Connect to wifi beginning with \"esp\" with your smartphone. "
         "The OLED screen will now hang.");
-        aOledLogger.redraw();
+        oledRedraw();
     };
 
     WiFiSettings.connect();//will require board reboot after setup
     ALOGI("IP: http://{}/",WiFi.localIP());
+    etagBootId = esp_random();
     initializeHttpServer();
 
     ALOGI("Application start!");
@@ -257,46 +609,90 @@ void setup(){
 
 void apiTest(){
     static int counter = 0;
-    int ret_code;
 
     if (digitalRead(PIN_BUT4) == LOW){
         ALOGI("Button 4 is pressed - doing test call");
-        ALOGI("Test call result: {0}",
-            mainHandleApiCall(
-                "REL/bits/"+std::to_string(counter++), &ret_code
-            ).as<std::string>()
-        );
+        std::string path = "REL/bits/"+std::to_string(counter++);
+        ctrlCall_t* call = runCall(apiCallJob, path.data(), path.length());
+        if (call == NULL){
+            return;
+        }
+        ALOGI("Test call result: {0}", std::string_view(call->buf, call->len));
+        ControllerTask.releaseCall(call);
+    }
+}
+
+typedef struct {
+    char buf[API_JSON_CAPACITY];
+    const char* event;
+    uint32_t seq;
+} stateEvent_t;
+
+// Builds the event on the controller task, returns false if there's
+// nothing to send. The changes are only marked as sent once the event
+// is built - a delta too long for the buffer is replaced by the whole
+// state.
+static bool stateEventJob(void* arg){
+    stateEvent_t* ev = (stateEvent_t*)arg;
+    PooledJson json;
+    if (!json.isValid()){
+        return false;
+    }
+    bool isFull = fullStateRequested.load();
+    if (!ioController.getStateDelta(*json, &isFull)){
+        return false;
+    }
+    if (!isFull && !fitsBuffer(*json, sizeof(ev->buf))){
+        ALOGW("State delta too long, sending the whole state");
+        (*json).clear();
+        isFull = true;
+        ioController.getStateDelta(*json, &isFull);
+    }
+    // configs are checked at load, see Config_::stateJsonLength()
+    if (!fitsReply(*json, sizeof(ev->buf))){
+        return false;
+    }
+    ioController.commitStateDelta();
+    if (isFull){
+        fullStateRequested = false;
     }
+    serializeJson(*json, ev->buf, sizeof(ev->buf));
+    ev->event = isFull ? "state" : "delta";
+    ev->seq = (*json)["seq"].as<uint32_t>();
+    return true;
+}
+
+// Sends state changed since the last update as a "delta" event, or
+// the whole state as "state" after a config reload, or when a new
+// client connects.
+void postStateUpdate(){
+    static stateEvent_t event;
+
+    if (!ControllerTask.run(CTRL_LANE_HOUSEKEEPING, stateEventJob, &event)){
+        return;
+    }
+    ALOGT("updating state by socket");
+    events.send(event.buf, event.event, event.seq);
 }
 
 int counter = 0;
 void loop()
 {
+    // woken up by ioController on every state change
     if (ulTaskNotifyTake(pdTRUE, 100 / portTICK_PERIOD_MS)){
         ALOGT("Task notified");
-        shouldPostSocketUpdate = true;
     }
 
-    aOledLogger.redraw();
+    oledRedraw();
     counter++;
     apiTest();
 
+    // carries the current sequence number, so clients can detect a gap
     if (counter%20 == 0){
-        events.send(".","heartbeat",millis());
-    }
-
-    if (counter%100 == 0){
-        shouldPostSocketUpdate = true;
+        events.send(std::to_string(ioController.getStateSeq()).c_str(),"heartbeat",0);
     }
 
-    if (shouldPostSocketUpdate){
-        ALOGT("updating state by socket");
-        shouldPostSocketUpdate = false;
-        std::string ret = (ioController.getIoControllerState()).as<std::string>();
-        events.send(ret.c_str(),"state",millis());
-
-        counter = 0;
-    }
+    postStateUpdate();
 }
 
 
@@ -326,12 +722,73 @@ void SerialTerminalTask(void *parameter)
     });
 
     clitussi.attachCommandCb("API",[](std::string cmd){
-        int ret_code;
+        std::string_view path = commandArgs(cmd);
+        ctrlCall_t* call = runCall(apiCallJob, path.data(), path.length());
+        if (call == NULL){
+            return;
+        }
+        ALOGV("Op result: {}", std::string_view(call->buf, call->len));
+        ControllerTask.releaseCall(call);
+    });
+
+    // "stats", "stats reset" or "stats <span>" - same as /api/STATS
+    clitussi.attachCommandCb("stats",[](std::string cmd){
+        std::string_view arg = commandArgs(cmd);
+        std::string path = arg.empty() ? "STATS" : "STATS/" + std::string(arg);
+        ctrlCall_t* call = runCall(apiCallJob, path.data(), path.length());
+        if (call == NULL){
+            return;
+        }
+        ALOGI("Stats: {}", std::string_view(call->buf, call->len));
+        ControllerTask.releaseCall(call);
+    });
+
+    // "BIN" reads, "BIN <hex>" applies a write frame,
+    // replies with "BIN <hex>" of binStateFrame_t
+    clitussi.attachCommandCb("BIN",[](std::string cmd){
+        uint8_t frame[BIN_MAX_WRITE_FRAME];
+        size_t len = 0;
+
+        std::string_view hex = commandArgs(cmd);
+        if ((hex.length() % 2 != 0) || (hex.length() / 2 > sizeof(frame))){
+            ALOGE("Invalid BIN frame");
+            return;
+        }
+        for (; len < hex.length() / 2; len++){
+            const char* digits = hex.data() + len * 2;
+            if (std::from_chars(digits, digits + 2, frame[len], 16).ec != std::errc()){
+                ALOGE("Invalid BIN frame");
+                return;
+            }
+        }
 
-        ALOGV("Op result: {}",
-            mainHandleApiCall(
-                cmd, &ret_code, API_SOURCE_SERIAL)
-                .as<std::string>(),ret_code);
+        ctrlCall_t* call = runCall(binaryCallJob, frame, len);
+        if (call == NULL){
+            return;
+        }
+        if (call->len != sizeof(binStateFrame_t)){
+            ALOGE("Controller busy");
+            ControllerTask.releaseCall(call);
+            return;
+        }
+        char out[2 * sizeof(binStateFrame_t) + 1];
+        for (size_t i = 0; i < call->len; i++){
+            snprintf(out + 2 * i, 3, "%02x", (uint8_t)call->buf[i]);
+        }
+        ControllerTask.releaseCall(call);
+        Serial.print("BIN ");
+        Serial.println(out);
+    });
+
+    // "batch BUT/a/A1;REL/1/on" - same as POST /api/batch
+    clitussi.attachCommandCb("batch",[](std::string cmd){
+        std::string_view body = commandArgs(cmd);
+        ctrlCall_t* call = runCall(batchCallJob, body.data(), body.length());
+        if (call == NULL){
+            return;
+        }
+        ALOGI("Batch result: {}", std::string_view(call->buf, call->len));
+        ControllerTask.releaseCall(call);
     });
 
     clitussi.attachCommandCb("ls",[](std::string cmd){
@@ -339,20 +796,20 @@ void SerialTerminalTask(void *parameter)
     });
 
     clitussi.attachCommandCb("cfg",[](std::string cmd){
-        Config.printConfig();
+        ConfigStore.get()->printConfig();
     });
 
     clitussi.attachCommandCb("reise",[](std::string cmd){
         throw std::runtime_error("reise");
     });
 
-    // crashes currently, warning
+    // hot reload - buttons that are on stay on, if still in the config
     clitussi.attachCommandCb("load",[](std::string cmd){
-        static char cfg[32];
+        char cfg[32];
         cfg[0] = '/';
         sscanf(cmd.c_str(), "load %30s", cfg+1);
 
-        Config.trySpawnLoaderTask(cfg);
+        ConfigStore.load(cfg);
     });
 
     for (;;){
@@ -0,0 +1,67 @@
+#ifndef SAFETY_BOUND_H
+#define SAFETY_BOUND_H
+
+#include <stdint.h>
+
+// Worst-case reaction time of the panic/lock path - from an edge on
+// a safety input to the safe words committed on every expander, not
+// counting the debounce configured for that input.
+//
+// The panic job waits for the controller job in progress, which issues
+// at most one bus job (see ButtonHandler::checkInputGuards() and
+// IoController::resyncExpanders()). The safe words are then written by
+// a single bus job on the safety lane. The OLED is redrawn outside of
+// the bus task, its transactions interleave with bus jobs (see
+// I2cBus_::begin()), so every bus job waits for at most one display
+// transaction in flight. Plain header, shared with the host-side test
+// (test/test_safety_bound).
+namespace safety {
+    // TwoWire default clock
+    constexpr uint32_t I2C_CLOCK_HZ = 100000;
+
+    constexpr uint32_t i2cTransferUs(uint32_t bytes){
+        // 9 clocks per byte, plus start and stop
+        return (uint32_t)(((uint64_t)(bytes * 9 + 2) * 1000000 + I2C_CLOCK_HZ - 1) / I2C_CLOCK_HZ);
+    }
+
+    // address, command, 2 data bytes
+    constexpr uint32_t EXPANDER_WRITE_US = i2cTransferUs(4);
+    // address, command, then address and 2 data bytes after a restart
+    constexpr uint32_t EXPANDER_READ_US = i2cTransferUs(2) + i2cTransferUs(3);
+    // TwoWire transmit buffer, the longest display transaction -
+    // one 128 column page of the frame buffer
+    constexpr uint32_t WIRE_BUFFER_BYTES = 128;
+    // address, then the buffer
+    constexpr uint32_t DISPLAY_TRANSFER_MAX_US = i2cTransferUs(1 + WIRE_BUFFER_BYTES);
+    // edge ISR -> watchdog task -> controller task -> bus task
+    constexpr uint32_t TASK_WAKE_US = 500;
+    // CPU time of a controller job around its bus job - parsing,
+    // JSON serialization (see the api and state spans)
+    constexpr uint32_t CONTROLLER_CPU_MAX_US = 2000;
+
+    // dead-time of a button switch, between "break" and "make"
+    constexpr uint32_t BREAK_BEFORE_MAKE_US = 1000;
+
+    constexpr uint32_t maxUs(uint32_t a, uint32_t b){
+        return (a > b) ? a : b;
+    }
+
+    // longest bus job of a controller job - a button switch, or a resync
+    constexpr uint32_t busJobMaxUs(int expanders){
+        return maxUs(2 * expanders * EXPANDER_WRITE_US + BREAK_BEFORE_MAKE_US,
+            expanders * (EXPANDER_READ_US + EXPANDER_WRITE_US));
+    }
+
+    // head-of-line blocking of the panic lane - the controller job in
+    // progress, with its bus job behind a display transaction
+    constexpr uint32_t controllerJobMaxUs(int expanders){
+        return CONTROLLER_CPU_MAX_US + DISPLAY_TRANSFER_MAX_US + busJobMaxUs(expanders);
+    }
+
+    constexpr uint32_t reactionBoundUs(int expanders){
+        return TASK_WAKE_US + controllerJobMaxUs(expanders) +
+            DISPLAY_TRANSFER_MAX_US + expanders * EXPANDER_WRITE_US;
+    }
+}
+
+#endif // SAFETY_BOUND_H
@@ -0,0 +1,129 @@
+#ifndef SHADOW_EXPANDER_H
+#define SHADOW_EXPANDER_H
+
+#include <Wire.h>
+#include <PCA95x5.h>
+
+#include "alfalog.h"
+#include "ioControllerTypes.h"
+#include "i2cBus.h"
+#include "traceSpan.h"
+
+// PCA9555 wrapper, that keeps an authoritative copy of the output
+// register in RAM. Reads are served from the shadow, writes go out
+// as a single 16-bit register write - the expander is never read
+// back, unless explicitly asked to by verify()/resync().
+// Bus traffic is executed by the I2cBus owner task.
+class ShadowExpander {
+public:
+    retCode_t attach(TwoWire& wire, int addr){
+        this->addr = addr;
+        exp.attach(wire, addr);
+
+        ALOGT("init exp {:#02x}", addr);
+        if (!I2cBus.run(I2C_LANE_API, configureJob, this)){
+            ALOGE("Expander {:#02x} config failed! Check the connections", addr);
+            return RET_ERR;
+        }
+        if (write(PCA95x5::Level::L_ALL)){
+            ALOGT("Expander OK!");
+            return RET_OK;
+        }
+        ALOGE("Expander {:#02x} Error! Check the connections", addr);
+        return RET_ERR;
+    }
+
+    bool write(uint16_t reg, i2cLane_t lane = I2C_LANE_API){
+        // shadow holds the requested state even if the bus fails,
+        // so that resync() can re-assert it later on.
+        shadow = reg;
+        if (!I2cBus.run(lane, writeJob, this)){
+            diverged = true;
+            writeErrors++;
+            ALOGE("Write {:#06x} to expander {:#02x} failed", reg, addr);
+            return false;
+        }
+        diverged = false;
+        return true;
+    }
+
+    bool writeMasked(uint16_t mask, uint16_t bits, i2cLane_t lane = I2C_LANE_API){
+        return write((shadow & ~mask) | (bits & mask), lane);
+    }
+
+    bool writePin(int port, bool val, i2cLane_t lane = I2C_LANE_API){
+        uint16_t mask = (uint16_t)0x01 << port;
+        return writeMasked(mask, val ? mask : 0x00, lane);
+    }
+
+    uint16_t read() const {
+        return shadow;
+    }
+
+    bool isPinHigh(int port) const {
+        return (shadow >> port) & 0x01;
+    }
+
+    // read back the port register, and compare it with the shadow.
+    // A failed read leaves the expander unverified (diverged).
+    bool verify(uint16_t* hwBits = NULL){
+        if (!I2cBus.run(I2C_LANE_API, readJob, this)){
+            diverged = true;
+            readErrors++;
+            ALOGE("Read from expander {:#02x} failed", addr);
+            return false;
+        }
+        uint16_t hw = readBack;
+        if (hwBits != NULL){
+            *hwBits = hw;
+        }
+        diverged = (hw != shadow);
+        if (diverged){
+            ALOGW("Expander {:#02x} diverged: shadow {:#06x}, hw {:#06x}",
+                addr, shadow, hw);
+        }
+        return !diverged;
+    }
+
+    // verify, and re-assert the shadow if hardware does not match it.
+    bool resync(){
+        if (verify()){
+            return true;
+        }
+        return write(shadow);
+    }
+
+    int getAddr() const { return addr; }
+    bool isDiverged() const { return diverged; }
+    uint32_t getWriteErrors() const { return writeErrors; }
+    uint32_t getReadErrors() const { return readErrors; }
+
+private:
+    static bool configureJob(void* arg){
+        ShadowExpander* self = (ShadowExpander*)arg;
+        bool isOk = self->exp.polarity(PCA95x5::Polarity::ORIGINAL_ALL);
+        return self->exp.direction(PCA95x5::Direction::OUT_ALL) && isOk;
+    }
+
+    static bool writeJob(void* arg){
+        TraceSpan span(SPAN_EXPANDER_WRITE);
+        ShadowExpander* self = (ShadowExpander*)arg;
+        return self->exp.write(self->shadow);
+    }
+
+    static bool readJob(void* arg){
+        ShadowExpander* self = (ShadowExpander*)arg;
+        self->readBack = self->exp.read();
+        return self->exp.i2c_error() == 0;
+    }
+
+    PCA9555 exp;
+    int addr = 0;
+    uint16_t shadow = 0x0000;
+    uint16_t readBack = 0x0000;
+    bool diverged = true;
+    uint32_t writeErrors = 0;
+    uint32_t readErrors = 0;
+};
+
+#endif // SHADOW_EXPANDER_H
@@ -0,0 +1,50 @@
+#include "traceSpan.h"
+
+TraceSpans_ &TraceSpans = TraceSpans.getInstance();
+
+static const char* spanNames[SPAN_COUNT] = {
+    "api", "expander", "guards", "state", "oled",
+    "config", "image", "builtin"
+};
+
+span_t TraceSpans_::spanFromName(std::string_view name){
+    for (int i = 0; i < SPAN_COUNT; i++){
+        if (name == spanNames[i]){
+            return (span_t)i;
+        }
+    }
+    return SPAN_COUNT;
+}
+
+const char* TraceSpans_::getName(span_t span){
+    return spanNames[span];
+}
+
+void TraceSpans_::getStats(JsonObject& jsonRef){
+    uint32_t cpuMhz = getCpuFrequencyMhz();
+    jsonRef["cpuMhz"] = cpuMhz;
+    for (int i = 0; i < SPAN_COUNT; i++){
+        JsonObject spanJson = jsonRef.createNestedObject(spanNames[i]);
+        histograms[i].getSummary(spanJson, cpuMhz);
+        spanJson["avgCycles"] = histograms[i].getAvg();
+        spanJson["migrated"] = migrated[i];
+    }
+}
+
+void TraceSpans_::getSpanStats(span_t span, JsonObject& jsonRef){
+    uint32_t cpuMhz = getCpuFrequencyMhz();
+    jsonRef["cpuMhz"] = cpuMhz;
+    JsonObject spanJson = jsonRef.createNestedObject(spanNames[span]);
+    histograms[span].getStats(spanJson, cpuMhz);
+    spanJson["avgCycles"] = histograms[span].getAvg();
+    spanJson["migrated"] = migrated[span];
+}
+
+void TraceSpans_::reset(){
+    for (auto& h: histograms){
+        h.reset();
+    }
+    for (auto& m: migrated){
+        m = 0;
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef TRACE_SPAN_H
+#define TRACE_SPAN_H
+
+#include <Arduino.h>
+#undef B1
+#include <string_view>
+#include "ArduinoJson.h"
+#include "latencyHistogram.h"
+
+// Hot paths timed with the CPU cycle counter, see /api/STATS.
+// A span is two counter reads and a histogram update - no allocation,
+// and no locks outside of the config loads - so it is left enabled in
+// production builds.
+// -DDISABLE_TRACE_SPANS compiles the spans out.
+typedef enum {
+    SPAN_API_CALL = 0,      // mainHandleApiCall
+    SPAN_EXPANDER_WRITE,    // single expander register write
+    SPAN_PIN_GUARDS,        // ButtonHandler::checkInputGuards
+    SPAN_STATE_JSON,        // IoController::getIoControllerState
+    SPAN_OLED_REDRAW,       // AdvancedOledLogger::redraw
+    // config loaders, any task may (re)load a config
+    SPAN_CONFIG_TOML,       // Config_::loadConfig
+    SPAN_CONFIG_IMAGE,      // Config_::loadCompiledConfig
+    SPAN_CONFIG_BUILTIN,    // Config_::loadBuiltinConfig
+    SPAN_COUNT
+} span_t;
+
+inline bool isSharedSpan(span_t span){
+    return span >= SPAN_CONFIG_TOML;
+}
+
+// CPU cycles - bucket 0 is 0, bucket i covers [2^(i-1), 2^i)
+typedef Log2Histogram<32, 0> SpanHistogram;
+
+// Spans before SPAN_CONFIG_TOML are recorded by a single task each (see
+// the call sites), the config loads may overlap, so they are recorded
+// in a critical section. All of them are read by the controller task -
+// a reset may lose a span in progress.
+class TraceSpans_ {
+public:
+    TraceSpans_() = default;
+
+    static TraceSpans_ &getInstance(){
+        static TraceSpans_ instance;
+        return instance;
+    }
+
+    void record(span_t span, uint32_t cycles){
+        if (isSharedSpan(span)){
+            portENTER_CRITICAL(&sharedMux);
+            histograms[span].record(cycles);
+            portEXIT_CRITICAL(&sharedMux);
+            return;
+        }
+        histograms[span].record(cycles);
+    }
+
+    // the task moved to the other core - cycle counters of the
+    // cores are not synchronized, so the span can't be measured
+    void discard(span_t span){
+        if (isSharedSpan(span)){
+            portENTER_CRITICAL(&sharedMux);
+            migrated[span]++;
+            portEXIT_CRITICAL(&sharedMux);
+            return;
+        }
+        migrated[span]++;
+    }
+
+    // SPAN_COUNT if not found
+    static span_t spanFromName(std::string_view name);
+    static const char* getName(span_t span);
+
+    // summary of every span, or buckets of a single one
+    void getStats(JsonObject& jsonRef);
+    void getSpanStats(span_t span, JsonObject& jsonRef);
+    void reset();
+
+private:
+    SpanHistogram histograms[SPAN_COUNT];
+    uint32_t migrated[SPAN_COUNT] = {};
+    portMUX_TYPE sharedMux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+extern TraceSpans_ &TraceSpans;
+
+#ifndef DISABLE_TRACE_SPANS
+
+// Scope guard, recording its lifetime
+class TraceSpan {
+public:
+    explicit TraceSpan(span_t span) :
+        span(span), core(xPortGetCoreID()), startCycles(ESP.getCycleCount()) {}
+
+    ~TraceSpan(){
+        uint32_t cycles = ESP.getCycleCount() - startCycles;
+        if (xPortGetCoreID() != core){
+            TraceSpans.discard(span);
+            return;
+        }
+        TraceSpans.record(span, cycles);
+    }
+
+private:
+    span_t span;
+    BaseType_t core;
+    uint32_t startCycles;
+};
+
+#else
+
+class TraceSpan {
+public:
+    explicit TraceSpan(span_t span) {}
+};
+
+#endif // DISABLE_TRACE_SPANS
+
+#endif // TRACE_SPAN_H
@@ -0,0 +1,110 @@
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+// Arduino core shim for the native environment (see platformio.ini).
+// Only what the controller core uses - GPIOs read from mock_gpio_in,
+// time from the host steady clock, or from mock_clock_us while
+// mock_clock_manual is set (delayMicroseconds() then advances it).
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+
+#include "freertosShim.h"
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLDOWN 0x09
+#define CHANGE 0x03
+#define RISING 0x01
+#define FALLING 0x02
+
+class String : public std::string {
+public:
+    String() {}
+    String(const char* s) : std::string(s ? s : "") {}
+    String(const std::string& s) : std::string(s) {}
+    String(int v) : std::string(std::to_string(v)) {}
+    String(unsigned v) : std::string(std::to_string(v)) {}
+    String(long v) : std::string(std::to_string(v)) {}
+    String(unsigned long v) : std::string(std::to_string(v)) {}
+    bool startsWith(const String& s) const { return rfind(s, 0) == 0; }
+    bool equals(const String& s) const { return *this == s; }
+    int toInt() const { return atoi(c_str()); }
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) { return 1; }
+    virtual size_t write(const uint8_t* buf, size_t len){
+        for (size_t i = 0; i < len; i++){
+            write(buf[i]);
+        }
+        return len;
+    }
+    size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t print(const String& s) { return print(s.c_str()); }
+    size_t println(const char* s = "") { return print(s) + write('\n'); }
+    size_t println(const String& s) { return println(s.c_str()); }
+};
+
+class HardwareSerial : public Print {
+public:
+    void begin(int) {}
+    int available() { return 0; }
+    int read() { return -1; }
+};
+extern HardwareSerial Serial;
+
+extern bool mock_clock_manual;
+extern uint64_t mock_clock_us;
+
+inline unsigned long micros(){
+    if (mock_clock_manual){
+        return mock_clock_us;
+    }
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+inline unsigned long millis() { return micros() / 1000; }
+inline int64_t esp_timer_get_time() { return micros(); }
+inline void delay(unsigned long) {}
+inline void delayMicroseconds(unsigned us){
+    if (mock_clock_manual){
+        mock_clock_us += us;
+    }
+}
+
+// input levels, bit per GPIO
+extern uint32_t mock_gpio_in;
+extern uint32_t mock_gpio_in1;
+
+inline void pinMode(int, int) {}
+inline int digitalRead(int pin){
+    return (pin < 32) ? (mock_gpio_in >> pin) & 0x01 : (mock_gpio_in1 >> (pin - 32)) & 0x01;
+}
+inline void digitalWrite(int, int) {}
+inline void attachInterruptArg(uint8_t, void (*)(void*), void*, int) {}
+inline void detachInterrupt(uint8_t) {}
+
+// the cycle counter runs at 240MHz, derived from the host clock
+class EspClass {
+public:
+    uint32_t getCycleCount() { return (uint32_t)(micros() * 240); }
+    uint32_t getFreeHeap() { return 0; }
+    uint32_t getCpuFreqMHz() { return 240; }
+};
+extern EspClass ESP;
+
+inline uint32_t getCpuFrequencyMhz() { return 240; }
+inline uint32_t esp_random() { return (uint32_t)rand(); }
+
+#endif // MOCK_ARDUINO_H
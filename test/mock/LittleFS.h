@@ -0,0 +1,59 @@
+#ifndef MOCK_LITTLEFS_H
+#define MOCK_LITTLEFS_H
+
+// Files are read from the host filesystem, relative to LittleFS.root
+// (the project directory when run by `pio test`).
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "Arduino.h"
+
+class File {
+public:
+    bool available() { return ok && (pos < data.size()); }
+    String readString(){
+        pos = data.size();
+        return String(data);
+    }
+    size_t read(uint8_t* buf, size_t len){
+        len = std::min(len, data.size() - pos);
+        memcpy(buf, data.data() + pos, len);
+        pos += len;
+        return len;
+    }
+    size_t size() { return data.size(); }
+    void close() {}
+    operator bool() const { return ok; }
+
+    std::string data;
+    size_t pos = 0;
+    bool ok = false;
+};
+
+namespace fs {
+class FS {
+public:
+    File open(const char* name, const char* mode = "r", bool create = false){
+        File file;
+        std::ifstream in(root + name);
+        if (in){
+            std::stringstream content;
+            content << in.rdbuf();
+            file.data = content.str();
+            file.ok = true;
+        }
+        return file;
+    }
+    bool exists(const char* name) { return (bool)std::ifstream(root + name); }
+    bool begin(bool formatOnFail) { return true; }
+
+    std::string root = "data";
+};
+}
+
+using fs::FS;
+extern fs::FS LittleFS;
+
+#endif // MOCK_LITTLEFS_H
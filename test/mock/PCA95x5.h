@@ -0,0 +1,51 @@
+#ifndef MOCK_PCA95X5_H
+#define MOCK_PCA95X5_H
+
+// PCA9555 without a bus - the output register is kept in RAM,
+// bus transfers are counted in mock_i2c_writes/mock_i2c_reads, and
+// all of them fail (NACK) while mock_i2c_fail is set. Each transfer
+// takes mock_i2c_write_us/mock_i2c_read_us of the mock clock.
+
+#include "Wire.h"
+
+namespace PCA95x5 {
+    namespace Level { enum Level : uint16_t { L, H, L_ALL = 0x0000, H_ALL = 0xFFFF }; }
+    namespace Polarity { enum Polarity : uint16_t { ORIGINAL, INVERTED, ORIGINAL_ALL = 0x0000, INVERTED_ALL = 0xFFFF }; }
+    namespace Direction { enum Direction : uint16_t { OUT, IN, OUT_ALL = 0x0000, IN_ALL = 0xFFFF }; }
+}
+
+extern uint32_t mock_i2c_writes;
+extern uint32_t mock_i2c_reads;
+extern bool mock_i2c_fail;
+extern uint32_t mock_i2c_write_us;
+extern uint32_t mock_i2c_read_us;
+
+class PCA9555 {
+public:
+    void attach(TwoWire& wire, uint8_t addr) { this->addr = addr; }
+    bool polarity(uint16_t) { return !mock_i2c_fail; }
+    bool direction(uint16_t) { return !mock_i2c_fail; }
+    bool write(uint16_t value){
+        mock_i2c_writes++;
+        delayMicroseconds(mock_i2c_write_us);
+        if (mock_i2c_fail){
+            return false;
+        }
+        out = value;
+        return true;
+    }
+    uint16_t read(){
+        mock_i2c_reads++;
+        delayMicroseconds(mock_i2c_read_us);
+        status = mock_i2c_fail ? 2 : 0;
+        return mock_i2c_fail ? 0xFFFF : out;
+    }
+    uint8_t i2c_error() const { return status; }
+
+private:
+    uint8_t addr = 0;
+    uint16_t out = 0xFFFF;
+    uint8_t status = 0;
+};
+
+#endif // MOCK_PCA95X5_H
@@ -0,0 +1,12 @@
+#ifndef MOCK_WIRE_H
+#define MOCK_WIRE_H
+
+#include "Arduino.h"
+
+class TwoWire {
+public:
+    TwoWire(int bus) {}
+    bool begin(int sda, int scl) { return true; }
+};
+
+#endif // MOCK_WIRE_H
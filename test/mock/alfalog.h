@@ -0,0 +1,38 @@
+#ifndef MOCK_ALFALOG_H
+#define MOCK_ALFALOG_H
+
+// alfalog macros printed to stdout, below mock_log_level are dropped -
+// the message is still formatted, like on the target.
+
+#include <cstdio>
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include "Arduino.h"
+
+template <> struct fmt::formatter<String> : fmt::formatter<std::string> {};
+
+typedef enum {
+    MOCK_LOG_TRACE = 0,
+    MOCK_LOG_DEBUG,
+    MOCK_LOG_INFO,
+    MOCK_LOG_WARNING,
+    MOCK_LOG_ERROR
+} mockLogLevel_t;
+
+extern mockLogLevel_t mock_log_level;
+
+#define MOCK_ALOG(level, tag, ...) do { \
+    std::string _msg = fmt::format(__VA_ARGS__); \
+    if ((level) >= mock_log_level) { printf("%s: %s\n", tag, _msg.c_str()); } \
+} while (0);
+
+#define ALOGT(...) MOCK_ALOG(MOCK_LOG_TRACE, "T", __VA_ARGS__)
+#define ALOGD(...) MOCK_ALOG(MOCK_LOG_DEBUG, "D", __VA_ARGS__)
+#define ALOGV(...) MOCK_ALOG(MOCK_LOG_DEBUG, "V", __VA_ARGS__)
+#define ALOGI(...) MOCK_ALOG(MOCK_LOG_INFO, "I", __VA_ARGS__)
+#define ALOGW(...) MOCK_ALOG(MOCK_LOG_WARNING, "W", __VA_ARGS__)
+#define ALOGE(...) MOCK_ALOG(MOCK_LOG_ERROR, "E", __VA_ARGS__)
+#define ALOGD_RAW(...) MOCK_ALOG(MOCK_LOG_DEBUG, "D", __VA_ARGS__)
+
+#endif // MOCK_ALFALOG_H
@@ -0,0 +1,9 @@
+#ifndef MOCK_COMMON_FW_UTILS_H
+#define MOCK_COMMON_FW_UTILS_H
+
+#define PATTERN_ERR 0
+#define PATTERN_HBEAT 1
+
+inline void handle_io_pattern(int pin, int pattern) {}
+
+#endif // MOCK_COMMON_FW_UTILS_H
@@ -0,0 +1,36 @@
+#ifndef MOCK_ESP_PARTITION_H
+#define MOCK_ESP_PARTITION_H
+
+// A single RAM-backed data partition, labeled mock_partition_label.
+// Erased bytes read as 0xFF, like on flash.
+
+#include <cstdint>
+#include <cstddef>
+
+#include "esp_spi_flash.h"
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef enum { ESP_PARTITION_TYPE_APP = 0, ESP_PARTITION_TYPE_DATA = 1 } esp_partition_type_t;
+typedef enum { ESP_PARTITION_SUBTYPE_ANY = 0xff } esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    uint32_t address;
+    uint32_t size;
+    const char* label;
+} esp_partition_t;
+
+extern const char* mock_partition_label;
+extern uint8_t mock_partition[0x10000];
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+    esp_partition_subtype_t subtype, const char* label);
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+    spi_flash_mmap_memory_t memory, const void** out, spi_flash_mmap_handle_t* handle);
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size);
+
+#endif // MOCK_ESP_PARTITION_H
@@ -0,0 +1,13 @@
+#ifndef MOCK_ESP_SPI_FLASH_H
+#define MOCK_ESP_SPI_FLASH_H
+
+#include <cstdint>
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef uint32_t spi_flash_mmap_handle_t;
+typedef enum { SPI_FLASH_MMAP_DATA, SPI_FLASH_MMAP_INST } spi_flash_mmap_memory_t;
+
+inline void spi_flash_munmap(spi_flash_mmap_handle_t handle) {}
+
+#endif // MOCK_ESP_SPI_FLASH_H
@@ -0,0 +1,162 @@
+#ifndef MOCK_FREERTOS_SHIM_H
+#define MOCK_FREERTOS_SHIM_H
+
+// Single-threaded FreeRTOS shim - tasks are never started, so the bus
+// and controller owners stay NULL and their jobs run in caller context.
+// Queues and semaphores work, but never block.
+//
+// A test may act as the tasks instead (see test_safety_bound) - with
+// mock_tasks_enabled, created tasks get distinct handles, the test
+// switches mock_current_task to the task it runs, and a take that
+// would block calls mock_block_hook to run the other tasks, until the
+// semaphore is given (or the hook returns false).
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+typedef void* TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void (*TaskFunction_t)(void*);
+
+struct mockTask {
+    TaskFunction_t fn;
+    void* arg;
+    TaskHandle_t handle;
+};
+extern bool mock_tasks_enabled;
+extern std::vector<mockTask> mock_tasks;
+extern TaskHandle_t mock_current_task;
+extern bool (*mock_block_hook)();
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffff
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(x) (x)
+#define configASSERT(x)
+#define portYIELD_FROM_ISR(...)
+#define tskNO_AFFINITY 0x7fffffff
+
+inline BaseType_t xTaskCreate(TaskFunction_t fn, const char*, uint32_t, void* arg, UBaseType_t, TaskHandle_t* handle){
+    TaskHandle_t created = NULL;
+    if (mock_tasks_enabled){
+        created = (TaskHandle_t)(uintptr_t)(0x100 + mock_tasks.size());
+        mock_tasks.push_back({fn, arg, created});
+    }
+    if (handle != NULL){
+        *handle = created;
+    }
+    return pdPASS;
+}
+// handle of the task created with arg, NULL if there is none
+inline TaskHandle_t mock_task_handle(const void* arg){
+    for (auto& task: mock_tasks){
+        if (task.arg == arg){
+            return task.handle;
+        }
+    }
+    return NULL;
+}
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack,
+        void* arg, UBaseType_t prio, TaskHandle_t* handle, int){
+    return xTaskCreate(fn, name, stack, arg, prio, handle);
+}
+inline void vTaskDelete(TaskHandle_t) {}
+inline void vTaskDelay(TickType_t) {}
+inline TickType_t xTaskGetTickCount() { return 0; }
+inline void vTaskDelayUntil(TickType_t*, TickType_t) {}
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return mock_current_task; }
+inline BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t*) {}
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+inline BaseType_t xPortGetCoreID() { return 0; }
+
+struct mockQueue {
+    std::deque<std::vector<uint8_t>> items;
+    size_t itemSize;
+    size_t length;
+};
+typedef mockQueue* QueueHandle_t;
+typedef struct { int dummy; } StaticQueue_t;
+
+inline QueueHandle_t xQueueCreate(size_t length, size_t itemSize){
+    return new mockQueue{{}, itemSize, length};
+}
+inline QueueHandle_t xQueueCreateStatic(size_t length, size_t itemSize, uint8_t*, StaticQueue_t*){
+    return xQueueCreate(length, itemSize);
+}
+inline BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t){
+    if (q->items.size() >= q->length){
+        return pdFALSE;
+    }
+    const uint8_t* bytes = (const uint8_t*)item;
+    q->items.emplace_back(bytes, bytes + q->itemSize);
+    return pdTRUE;
+}
+inline BaseType_t xQueueSendFromISR(QueueHandle_t q, const void* item, BaseType_t*){
+    return xQueueSend(q, item, 0);
+}
+inline BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t){
+    if (q->items.empty()){
+        return pdFALSE;
+    }
+    memcpy(item, q->items.front().data(), q->itemSize);
+    q->items.pop_front();
+    return pdTRUE;
+}
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) { return q->items.size(); }
+
+struct mockSemaphore {
+    int count;
+    int max;
+};
+typedef mockSemaphore* SemaphoreHandle_t;
+typedef struct { mockSemaphore sem; } StaticSemaphore_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new mockSemaphore{1, 1}; }
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return new mockSemaphore{0, 1}; }
+inline SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* buffer){
+    buffer->sem = {0, 1};
+    return &buffer->sem;
+}
+inline SemaphoreHandle_t xSemaphoreCreateCounting(int max, int initial){
+    return new mockSemaphore{initial, max};
+}
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t timeout){
+    while ((s->count == 0) && (timeout != 0) && (mock_block_hook != NULL)){
+        if (!mock_block_hook()){
+            break;
+        }
+    }
+    if (s->count == 0){
+        return pdFALSE;
+    }
+    s->count--;
+    return pdTRUE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s){
+    if (s->count == s->max){
+        return pdFALSE;
+    }
+    s->count++;
+    return pdTRUE;
+}
+inline BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t s, BaseType_t*){
+    return xSemaphoreGive(s);
+}
+inline void vSemaphoreDelete(SemaphoreHandle_t) {}
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+inline void portENTER_CRITICAL(portMUX_TYPE*) {}
+inline void portEXIT_CRITICAL(portMUX_TYPE*) {}
+inline void portENTER_CRITICAL_ISR(portMUX_TYPE*) {}
+inline void portEXIT_CRITICAL_ISR(portMUX_TYPE*) {}
+
+#endif // MOCK_FREERTOS_SHIM_H
@@ -0,0 +1,79 @@
+#include "Arduino.h"
+#include "LittleFS.h"
+#include "PCA95x5.h"
+#include "alfalog.h"
+#include "esp_partition.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+fs::FS LittleFS;
+
+uint32_t mock_gpio_in = 0;
+uint32_t mock_gpio_in1 = 0;
+uint32_t mock_i2c_writes = 0;
+uint32_t mock_i2c_reads = 0;
+bool mock_i2c_fail = false;
+uint32_t mock_i2c_write_us = 0;
+uint32_t mock_i2c_read_us = 0;
+bool mock_clock_manual = false;
+uint64_t mock_clock_us = 0;
+bool mock_tasks_enabled = false;
+std::vector<mockTask> mock_tasks;
+TaskHandle_t mock_current_task = (TaskHandle_t)0x01;
+bool (*mock_block_hook)() = NULL;
+mockLogLevel_t mock_log_level = MOCK_LOG_WARNING;
+
+// gracefulRestart.cpp is target-only
+void gracefulRestart() {}
+const char* getResetReasonStr() { return "native"; }
+bool lastRestartFaulty() { return false; }
+
+// ---- esp_partition.h ----
+
+const char* mock_partition_label = "config";
+uint8_t mock_partition[0x10000];
+
+static esp_partition_t mockPartition = {
+    ESP_PARTITION_TYPE_DATA, 0x3E0000, sizeof(mock_partition), NULL
+};
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+        esp_partition_subtype_t subtype, const char* label){
+    if ((type != ESP_PARTITION_TYPE_DATA) || (mock_partition_label == NULL) ||
+            (strcmp(label, mock_partition_label) != 0)){
+        return NULL;
+    }
+    mockPartition.label = mock_partition_label;
+    return &mockPartition;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t* partition, size_t offset, size_t size,
+        spi_flash_mmap_memory_t memory, const void** out, spi_flash_mmap_handle_t* handle){
+    if (offset + size > partition->size){
+        return ESP_FAIL;
+    }
+    *out = mock_partition + offset;
+    *handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size){
+    if ((offset % SPI_FLASH_SEC_SIZE != 0) || (size % SPI_FLASH_SEC_SIZE != 0) ||
+            (offset + size > partition->size)){
+        return ESP_FAIL;
+    }
+    memset(mock_partition + offset, 0xFF, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size){
+    if (offset + size > partition->size){
+        return ESP_FAIL;
+    }
+    // flash writes can only clear bits
+    const uint8_t* bytes = (const uint8_t*)src;
+    for (size_t i = 0; i < size; i++){
+        mock_partition[offset + i] &= bytes[i];
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,10 @@
+#ifndef MOCK_GPIO_REG_H
+#define MOCK_GPIO_REG_H
+
+#include "Arduino.h"
+
+#define GPIO_IN_REG 0x3ff4403c
+#define GPIO_IN1_REG 0x3ff44040
+#define REG_READ(reg) (((reg) == GPIO_IN_REG) ? mock_gpio_in : mock_gpio_in1)
+
+#endif // MOCK_GPIO_REG_H
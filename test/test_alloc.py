@@ -0,0 +1,54 @@
+import json
+import sys
+import urllib.parse
+import urllib.request
+
+# Checks that switching buttons does not allocate on the heap.
+# Requires firmware built with the "antcontroller-alloc" env
+# (-DALLOC_TRACKING) and buttons_simple.conf loaded.
+#
+# usage: python3 test_alloc.py <ip> [BUT/<group>/<button> ...]
+
+IP = "192.168.0.145"
+
+# define the commands to send
+commands = [
+    "BUT/a/A1",
+    "BUT/a/A2",
+    "BUT/b/B1",
+    "BUT/b/B2",
+    "BUT/c/C1",
+    "BUT/c/C2",
+    "BUT/d/ROT LEFT",
+    "BUT/d/ROT RIGHT",
+    "BUT/a/OFF",
+    "BUT/b/OFF",
+    "BUT/c/OFF",
+    "BUT/d/OFF"
+]
+
+if len(sys.argv) > 1:
+    IP = sys.argv[1]
+if len(sys.argv) > 2:
+    commands = sys.argv[2:]
+
+failed = 0
+
+for command in commands:
+    url = "http://" + IP + "/api/" + urllib.parse.quote(command)
+    with urllib.request.urlopen(url) as resp:
+        jsonResp = json.loads(resp.read())
+
+    if "allocs" not in jsonResp:
+        print("no allocation count in response - is ALLOC_TRACKING enabled?")
+        sys.exit(2)
+
+    allocs = jsonResp["allocs"]
+    status = "OK" if allocs == 0 else "FAIL"
+    print("{:<24} {:<4} allocs: {} ({})".format(command, jsonResp["msg"], allocs, status))
+    if allocs != 0:
+        failed += 1
+
+if failed > 0:
+    print("{} of {} calls allocated".format(failed, len(commands)))
+    sys.exit(1)
@@ -0,0 +1,65 @@
+// Heap allocations of the button API path, counted by allocTracker.h -
+// the host-side counterpart of test/test_alloc.py. Run with
+// `pio test -e native`.
+
+#include <unity.h>
+
+// src is built without -DALLOC_TRACKING (test_benchmark replaces
+// operator new itself), so the tracker is compiled into this test only
+#define ALLOC_TRACKING
+#include "allocTracker.cpp"
+
+#include "ioController.h"
+#include "configHandler.h"
+#include "apiCommand.h"
+#include "jsonPool.h"
+
+static TwoWire wire(0);
+static IoController ioController;
+
+// same scope as mainHandleApiCall() - parsing and the call itself
+static uint32_t callAllocs(const char* path){
+    PooledJson json;
+    AllocScope allocScope;
+    apiCommand_t cmd;
+    parseApiCommand(path, cmd);
+    ioController.handleApiCall(cmd, *json);
+    uint32_t allocs = allocScope.end();
+
+    TEST_ASSERT_EQUAL_STRING_MESSAGE("OK", (*json)["msg"].as<const char*>(), path);
+    return allocs;
+}
+
+void setUp(){}
+
+void tearDown(){}
+
+void test_buttons_do_not_allocate(){
+    const char* paths[] = {
+        "BUT/a/A1", "BUT/a/A2", "BUT/b/B1", "BUT/b/B2",
+        "BUT/c/C1", "BUT/c/C2", "BUT/d/ROT LEFT", "BUT/d/ROT RIGHT",
+        "BUT/a/OFF", "BUT/b/OFF", "BUT/c/OFF", "BUT/d/OFF"
+    };
+    for (auto path: paths){
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, callAllocs(path), path);
+    }
+}
+
+void test_scope_counts_allocations(){
+    AllocScope allocScope;
+    // a function call, unlike a new-expression, can't be elided
+    void* p = operator new(16);
+    operator delete(p);
+    TEST_ASSERT_EQUAL_UINT32(1, allocScope.end());
+}
+
+int main(int argc, char **argv){
+    JsonPool.begin();
+    ioController.begin(wire);
+    ConfigStore.loadBuiltin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_buttons_do_not_allocate);
+    RUN_TEST(test_scope_counts_allocations);
+    return UNITY_END();
+}
@@ -0,0 +1,367 @@
+// Host-side benchmarks of the controller core, against the shims in
+// test/mock. Run with `pio test -e native -f test_benchmark -v` to see
+// the timings. Every benchmark runs on a small config, and on a
+// synthetic large one (hundreds of pins and buttons, dense guards) -
+// paths expected not to depend on the config size fail, if they
+// slow down more than MAX_SCALING times on the large one.
+
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ioController.h"
+#include "configHandler.h"
+#include "configImage.h"
+#include "apiCommand.h"
+#include "jsonPool.h"
+
+// ---- heap accounting ----
+
+static size_t heapInUse = 0;
+static size_t heapPeak = 0;
+
+// size is kept in front of the block, which stays max-aligned
+static const size_t HEAP_HEADER = alignof(std::max_align_t);
+
+void* operator new(size_t size){
+    uint8_t* p = (uint8_t*)malloc(size + HEAP_HEADER);
+    if (p == NULL){
+        throw std::bad_alloc();
+    }
+    *(size_t*)p = size;
+    heapInUse += size;
+    if (heapInUse > heapPeak){
+        heapPeak = heapInUse;
+    }
+    return p + HEAP_HEADER;
+}
+
+void* operator new[](size_t size){
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    if (p == NULL){
+        return;
+    }
+    uint8_t* block = (uint8_t*)p - HEAP_HEADER;
+    heapInUse -= *(size_t*)block;
+    free(block);
+}
+
+void operator delete[](void* p) noexcept {
+    operator delete(p);
+}
+
+void operator delete(void* p, size_t size) noexcept {
+    operator delete(p);
+}
+
+void operator delete[](void* p, size_t size) noexcept {
+    operator delete(p);
+}
+
+// ---- synthetic configs ----
+
+typedef struct {
+    const char* name;
+    int aliases;        // names per output channel
+    int groups;         // up to MAX_BUTTON_GROUPS
+    int buttonsPerGroup;
+    int pinsPerButton;
+    int guardsPerButton;
+} benchConfig_t;
+
+const benchConfig_t SMALL_CONFIG = {"small", 1, 4, 4, 1, 1};
+const benchConfig_t LARGE_CONFIG = {"large", 8, MAX_BUTTON_GROUPS, 16, 4, 8};
+
+// output channels, in the antctrl naming of the configs
+const struct {
+    const char* antctrl;
+    int count;
+} CHANNELS[] = {
+    {"SINK", 16}, {"RL", 15}, {"OC", 8}, {"TTL", 8}
+};
+
+// inputs used for guards - lock and panic are left out
+const int GUARD_INPUTS[] = {2, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+const int GUARD_INPUT_COUNT = sizeof(GUARD_INPUTS) / sizeof(GUARD_INPUTS[0]);
+
+const int MAX_SCALING = 8;
+
+static std::string pinName(int alias, const char* antctrl, int num){
+    return "P" + std::to_string(alias) + "_" + antctrl + std::to_string(num);
+}
+
+static std::string buttonName(int button){
+    return "B" + std::to_string(button);
+}
+
+static std::string groupName(int group){
+    return "G" + std::to_string(group);
+}
+
+static std::string makeConfig(const benchConfig_t& c){
+    std::vector<std::string> outputNames;
+    std::string toml;
+
+    for (int alias = 0; alias < c.aliases; alias++){
+        for (auto& ch: CHANNELS){
+            for (int num = 1; num <= ch.count; num++){
+                std::string name = pinName(alias, ch.antctrl, num);
+                toml += "[[pin]]\nname = \"" + name + "\"\n" +
+                    "antctrl = \"" + ch.antctrl + std::to_string(num) + "\"\n" +
+                    "sch = \"S" + name + "\"\n\n";
+                outputNames.push_back(name);
+            }
+        }
+    }
+    for (int num = 1; num <= INPUT_GUARD_BITS; num++){
+        toml += "[[pin]]\nname = \"IN" + std::to_string(num) + "\"\n" +
+            "antctrl = \"INP" + std::to_string(num) + "\"\n" +
+            "sch = \"SIN" + std::to_string(num) + "\"\n\n";
+    }
+
+    // guards disable on high, so every button can be activated while
+    // the inputs are low
+    int pin = 0;
+    for (int g = 0; g < c.groups; g++){
+        for (int b = 0; b < c.buttonsPerGroup; b++){
+            toml += "[[buttons." + groupName(g) + "]]\n" +
+                "name = \"" + buttonName(b) + "\"\npins = [";
+            for (int p = 0; p < c.pinsPerButton; p++){
+                toml += "\"" + outputNames[pin++ % outputNames.size()] + "\",";
+            }
+            toml += "]\ndisable_on_high = [";
+            for (int i = 0; i < c.guardsPerButton; i++){
+                int input = GUARD_INPUTS[(b + i) % GUARD_INPUT_COUNT];
+                toml += "\"IN" + std::to_string(input) + "\",";
+            }
+            toml += "]\n\n";
+        }
+    }
+    return toml;
+}
+
+// ---- timing ----
+
+typedef std::chrono::steady_clock benchClock;
+
+template <typename F>
+static double nsPerOp(int iterations, F fn){
+    auto start = benchClock::now();
+    for (int i = 0; i < iterations; i++){
+        fn(i);
+    }
+    std::chrono::duration<double, std::nano> elapsed = benchClock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+static void report(const benchConfig_t& c, const char* bench, double ns){
+    printf("bench %-6s %-24s %12.0f ns/op\n", c.name, bench, ns);
+}
+
+static TwoWire wire(0);
+static IoController ioController;
+
+static void loadConfig(const benchConfig_t& c){
+    std::istringstream istr(makeConfig(c));
+    std::shared_ptr<Config_> next = std::make_shared<Config_>();
+    TEST_ASSERT_TRUE(next->parseToml(istr, c.name));
+    TEST_ASSERT_EQUAL_INT(c.groups * c.buttonsPerGroup, next->buttons.size());
+    ConfigStore.publish(next);
+}
+
+// ---- benchmarks ----
+
+static void benchConfigParse(const benchConfig_t& c, double* result){
+    const int ITERATIONS = 5;
+    std::string toml = makeConfig(c);
+    Config_ config;
+    size_t peakBytes = 0;
+
+    double ns = nsPerOp(ITERATIONS, [&](int i){
+        config.clearPresets();
+        size_t baseline = heapInUse;
+        heapPeak = heapInUse;
+        std::istringstream istr(toml);
+        config.parseToml(istr, c.name);
+        if (heapPeak - baseline > peakBytes){
+            peakBytes = heapPeak - baseline;
+        }
+    });
+    report(c, "config parse", ns);
+    printf("bench %-6s %-24s %12zu B (%zu B of toml)\n",
+        c.name, "config parse peak heap", peakBytes, toml.size());
+    *result = ns;
+}
+
+// the boot path with a valid compiled config, see configImage.h
+static void benchImageLoad(const benchConfig_t& c, double* result){
+    const int ITERATIONS = 50;
+    const uint32_t SOURCE_HASH = 1;
+    std::vector<uint8_t> image;
+    configImage::build(ConfigStore.active(), SOURCE_HASH, image);
+    Config_ config;
+    size_t peakBytes = 0;
+    bool isOk = true;
+
+    double ns = nsPerOp(ITERATIONS, [&](int i){
+        config.clearPresets();
+        size_t baseline = heapInUse;
+        heapPeak = heapInUse;
+        isOk &= (configImage::validate(image.data(), image.size(), SOURCE_HASH) == NULL);
+        configImage::decode(image.data(), config);
+        if (heapPeak - baseline > peakBytes){
+            peakBytes = heapPeak - baseline;
+        }
+    });
+    TEST_ASSERT_TRUE(isOk);
+    TEST_ASSERT_EQUAL_INT(c.groups * c.buttonsPerGroup, config.buttons.size());
+    report(c, "image load", ns);
+    printf("bench %-6s %-24s %12zu B (%zu B of image)\n",
+        c.name, "image load peak heap", peakBytes, image.size());
+    *result = ns;
+}
+
+static void benchApiParse(const benchConfig_t& c, double* result){
+    const int ITERATIONS = 200000;
+    std::vector<std::string> paths = {
+        "REL/bits/127", "MOS/3/on", "INP/bits", "OPT/1",
+        "BUT/" + groupName(c.groups - 1) + "/" + buttonName(c.buttonsPerGroup - 1),
+        "BUT/" + groupName(0) + "/OFF"
+    };
+    apiCommand_t cmd;
+    double ns = nsPerOp(ITERATIONS, [&](int i){
+        parseApiCommand(paths[i % paths.size()], cmd);
+    });
+    TEST_ASSERT_NULL(cmd.error);
+    report(c, "API parse", ns);
+    *result = ns;
+}
+
+static void benchButtonActivation(const benchConfig_t& c, double* result){
+    const int ITERATIONS = 20000;
+    // every button of the last group in turn
+    std::vector<apiCommand_t> cmds(c.buttonsPerGroup);
+    for (int b = 0; b < c.buttonsPerGroup; b++){
+        std::string path = "BUT/" + groupName(c.groups - 1) + "/" + buttonName(b);
+        TEST_ASSERT_TRUE(parseApiCommand(path, cmds[b]));
+    }
+    bool isOk = true;
+    double ns = nsPerOp(ITERATIONS, [&](int i){
+        PooledJson json;
+        ioController.handleApiCall(cmds[i % cmds.size()], *json);
+        isOk &= (strcmp((*json)["msg"].as<const char*>(), "OK") == 0);
+    });
+    TEST_ASSERT_TRUE(isOk);
+    report(c, "button activation", ns);
+    *result = ns;
+}
+
+static void benchGuardRecheck(const benchConfig_t& c, double* result){
+    const int ITERATIONS = 20000;
+    uint16_t guardedBits = 0;
+    for (auto input: GUARD_INPUTS){
+        guardedBits |= (uint16_t)0x01 << (input - 1);
+    }
+    // every guarded input changes, with no button active - all the
+    // guards are checked, none of them trips
+    for (int g = 0; g < c.groups; g++){
+        apiCommand_t cmd;
+        parseApiCommand("BUT/" + groupName(g) + "/OFF", cmd);
+        PooledJson json;
+        ioController.handleApiCall(cmd, *json);
+    }
+    uint32_t writes = mock_i2c_writes;
+    double ns = nsPerOp(ITERATIONS, [&](int i){
+        ioController.notifyOnBitsChange((i % 2) ? guardedBits : 0x0000);
+    });
+    ioController.notifyOnBitsChange(0x0000);
+    TEST_ASSERT_EQUAL_UINT32(writes, mock_i2c_writes);
+    report(c, "guard recheck", ns);
+    *result = ns;
+}
+
+static void benchStateSerialization(const benchConfig_t& c, double* result){
+    const int ITERATIONS = 20000;
+    static char buf[API_JSON_CAPACITY];
+    size_t len = 0;
+    double ns = nsPerOp(ITERATIONS, [&](int i){
+        PooledJson json;
+        ioController.getIoControllerState(*json);
+        len = serializeJson(*json, buf, sizeof(buf));
+    });
+    TEST_ASSERT_TRUE(len > 0);
+    report(c, "state serialization", ns);
+    *result = ns;
+}
+
+typedef struct {
+    double configParse;
+    double imageLoad;
+    double apiParse;
+    double buttonActivation;
+    double guardRecheck;
+    double stateSerialization;
+} benchResults_t;
+
+// asserts return from the test, so the results are filled in place
+static void runAll(const benchConfig_t& c, benchResults_t& r){
+    benchConfigParse(c, &r.configParse);
+    loadConfig(c);
+    benchImageLoad(c, &r.imageLoad);
+    benchApiParse(c, &r.apiParse);
+    benchGuardRecheck(c, &r.guardRecheck);
+    benchButtonActivation(c, &r.buttonActivation);
+    benchStateSerialization(c, &r.stateSerialization);
+}
+
+static benchResults_t small;
+static benchResults_t large;
+
+void test_bench_small(){
+    runAll(SMALL_CONFIG, small);
+}
+
+void test_bench_large(){
+    runAll(LARGE_CONFIG, large);
+}
+
+static bool scalesWithin(const char* bench, double smallNs, double largeNs){
+    double ratio = largeNs / smallNs;
+    printf("bench %-31s %12.1fx\n", bench, ratio);
+    return ratio < MAX_SCALING;
+}
+
+// name lookups are indexed, and the state has a fixed layout
+void test_lookups_do_not_scale(){
+    TEST_ASSERT_TRUE(scalesWithin("API parse", small.apiParse, large.apiParse));
+    TEST_ASSERT_TRUE(scalesWithin("button activation", small.buttonActivation, large.buttonActivation));
+    TEST_ASSERT_TRUE(scalesWithin("state serialization", small.stateSerialization, large.stateSerialization));
+}
+
+void test_image_load_beats_parse(){
+    printf("bench %-31s %12.1fx\n", "image load vs parse", large.configParse / large.imageLoad);
+    TEST_ASSERT_TRUE(large.imageLoad < large.configParse);
+}
+
+int main(int argc, char **argv){
+    JsonPool.begin();
+    loadConfig(SMALL_CONFIG);
+    ioController.begin(wire);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_bench_small);
+    RUN_TEST(test_bench_large);
+    RUN_TEST(test_lookups_do_not_scale);
+    RUN_TEST(test_image_load_beats_parse);
+    return UNITY_END();
+}
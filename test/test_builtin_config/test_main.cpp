@@ -0,0 +1,108 @@
+// Built-in fallback config (src/builtinConfig.h) - the generated tables
+// have to load into the same config as parsing data/buttons_simple.conf.
+// Fails if the header is stale, rebuild or run gen_builtin_config.py.
+// Run with `pio test -e native`.
+
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+#include "configHandler.h"
+#include "builtinConfig.h"
+
+static Config_ config;
+static std::vector<pin_t> pins;
+static std::vector<button_t> buttons;
+static std::vector<buttonGroup_t> groups;
+static uint16_t guardedInputs;
+
+static bool sameTx(const outputTransaction_t& a, const outputTransaction_t& b){
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+void setUp(){
+    config.clearPresets();
+    TEST_ASSERT_TRUE(config.loadConfig("/buttons_simple.conf"));
+    pins = config.pins;
+    buttons = config.buttons;
+    groups = config.button_groups;
+    guardedInputs = config.guardedInputs;
+}
+
+void tearDown(){}
+
+void test_same_as_parsed(){
+    config.loadBuiltinConfig();
+
+    TEST_ASSERT_TRUE(config.is_valid);
+    TEST_ASSERT_EQUAL_STRING(builtin::NAME, config.config_filename.c_str());
+
+    TEST_ASSERT_EQUAL_INT(pins.size(), config.pins.size());
+    for (int i = 0; i < pins.size(); i++){
+        const pin_t& pin = config.pins[i];
+        TEST_ASSERT_EQUAL_STRING(pins[i].name.c_str(), pin.name.c_str());
+        TEST_ASSERT_EQUAL_STRING(pins[i].sch.c_str(), pin.sch.c_str());
+        TEST_ASSERT_EQUAL_INT(pins[i].ioType, pin.ioType);
+        TEST_ASSERT_EQUAL_INT(pins[i].ioNum, pin.ioNum);
+        TEST_ASSERT_EQUAL_INT(pins[i].filterMode, pin.filterMode);
+        TEST_ASSERT_EQUAL_INT(pins[i].assertMs, pin.assertMs);
+        TEST_ASSERT_EQUAL_INT(pins[i].deassertMs, pin.deassertMs);
+        TEST_ASSERT_EQUAL_INT(pins[i].pinGuards.size(), pin.pinGuards.size());
+        for (int g = 0; g < pin.pinGuards.size(); g++){
+            TEST_ASSERT_EQUAL_INT(pins[i].pinGuards[g].buttonId, pin.pinGuards[g].buttonId);
+            TEST_ASSERT_EQUAL_INT(pins[i].pinGuards[g].onHigh, pin.pinGuards[g].onHigh);
+        }
+    }
+
+    TEST_ASSERT_EQUAL_INT(buttons.size(), config.buttons.size());
+    for (int i = 0; i < buttons.size(); i++){
+        const button_t& button = config.buttons[i];
+        TEST_ASSERT_EQUAL_STRING(buttons[i].name.c_str(), button.name.c_str());
+        TEST_ASSERT_EQUAL_INT(buttons[i].id, button.id);
+        TEST_ASSERT_EQUAL_INT(buttons[i].groupId, button.groupId);
+        TEST_ASSERT_TRUE(buttons[i].pinIds == button.pinIds);
+        TEST_ASSERT_TRUE(sameTx(buttons[i].outputs, button.outputs));
+        TEST_ASSERT_EQUAL_INT(0, memcmp(&buttons[i].guardMask, &button.guardMask, sizeof(guardMask_t)));
+    }
+
+    TEST_ASSERT_EQUAL_INT(groups.size(), config.button_groups.size());
+    for (int i = 0; i < groups.size(); i++){
+        const buttonGroup_t& group = config.button_groups[i];
+        TEST_ASSERT_EQUAL_STRING(groups[i].name.c_str(), group.name.c_str());
+        TEST_ASSERT_TRUE(groups[i].buttonIds == group.buttonIds);
+        TEST_ASSERT_TRUE(sameTx(groups[i].reset, group.reset));
+    }
+
+    TEST_ASSERT_EQUAL_HEX16(guardedInputs, config.guardedInputs);
+    for (auto& button: buttons){
+        TEST_ASSERT_EQUAL_INT(button.groupId, config.findGroup(groups[button.groupId].name));
+        TEST_ASSERT_EQUAL_INT(button.id, config.findButton(button.groupId, button.name));
+    }
+}
+
+// computed by the compiler, same as Config_::compileOutputMask()
+void test_outputs_compiled(){
+    constexpr builtin::outputTables_t outputs = builtin::compileOutputs();
+    for (int i = 0; i < builtin::BUTTON_COUNT; i++){
+        TEST_ASSERT_TRUE(sameTx(buttons[i].outputs, outputs.buttons[i]));
+    }
+    for (int i = 0; i < builtin::GROUP_COUNT; i++){
+        TEST_ASSERT_TRUE(sameTx(groups[i].reset, outputs.groupReset[i]));
+    }
+}
+
+// served by /api/config in place of the file
+void test_source_embedded(){
+    File file = LittleFS.open("/buttons_simple.conf");
+    TEST_ASSERT_TRUE(file);
+    TEST_ASSERT_EQUAL_STRING(file.readString().c_str(), builtin::SOURCE);
+}
+
+int main(int argc, char **argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_same_as_parsed);
+    RUN_TEST(test_outputs_compiled);
+    RUN_TEST(test_source_embedded);
+    return UNITY_END();
+}
@@ -0,0 +1,197 @@
+// Compiled config (src/configImage.h) - a config decoded from its
+// image has to be the same as the parsed one, and damaged or stale
+// images must be rejected. Run with `pio test -e native`.
+
+#include <unity.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "configHandler.h"
+#include "configImage.h"
+#include "esp_partition.h"
+
+const char TEST_CONFIG[] = R"(
+[[pin]]
+name = "ANT1"
+antctrl = "RL1"
+sch = "RL1"
+
+[[pin]]
+name = "ANT2"
+antctrl = "RL2"
+sch = "RL2"
+
+[[pin]]
+name = "AMP"
+antctrl = "SINK3"
+sch = "SINK3"
+
+[[pin]]
+name = "PTT"
+antctrl = "INP4"
+sch = "IN4"
+debounce = 50
+filter = "integrator"
+
+[[buttons.a]]
+name = "first"
+pins = ["ANT1", "AMP"]
+disable_on_high = ["PTT"]
+
+[[buttons.a]]
+name = "second"
+pins = ["ANT2"]
+disable_on_low = ["AMP"]
+
+[[buttons.b]]
+name = "amp"
+pins = ["AMP"]
+)";
+
+const uint32_t SOURCE_HASH = 0x12345678;
+
+static Config_ config;
+static std::vector<uint8_t> image;
+
+static void parseTestConfig(){
+    std::istringstream istr(TEST_CONFIG);
+    config.clearPresets();
+    TEST_ASSERT_TRUE(config.parseToml(istr, "test"));
+    config.config_filename = "/test.conf";
+}
+
+static bool sameTx(const outputTransaction_t& a, const outputTransaction_t& b){
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+void setUp(){
+    parseTestConfig();
+    configImage::build(config, SOURCE_HASH, image);
+}
+
+void tearDown(){}
+
+void test_roundtrip(){
+    // a copy of the parsed config, to compare with
+    std::vector<pin_t> pins = config.pins;
+    std::vector<button_t> buttons = config.buttons;
+    std::vector<buttonGroup_t> groups = config.button_groups;
+    uint16_t guardedInputs = config.guardedInputs;
+
+    TEST_ASSERT_NULL(configImage::validate(image.data(), image.size(), SOURCE_HASH));
+    config.clearPresets();
+    configImage::decode(image.data(), config);
+
+    TEST_ASSERT_TRUE(config.is_valid);
+    TEST_ASSERT_EQUAL_STRING("/test.conf", config.config_filename.c_str());
+
+    TEST_ASSERT_EQUAL_INT(pins.size(), config.pins.size());
+    for (int i = 0; i < pins.size(); i++){
+        const pin_t& pin = config.pins[i];
+        TEST_ASSERT_EQUAL_STRING(pins[i].name.c_str(), pin.name.c_str());
+        TEST_ASSERT_EQUAL_STRING(pins[i].sch.c_str(), pin.sch.c_str());
+        TEST_ASSERT_EQUAL_INT(pins[i].ioType, pin.ioType);
+        TEST_ASSERT_EQUAL_INT(pins[i].ioNum, pin.ioNum);
+        TEST_ASSERT_EQUAL_INT(pins[i].filterMode, pin.filterMode);
+        TEST_ASSERT_EQUAL_INT(pins[i].assertMs, pin.assertMs);
+        TEST_ASSERT_EQUAL_INT(pins[i].deassertMs, pin.deassertMs);
+        TEST_ASSERT_EQUAL_INT(pins[i].pinGuards.size(), pin.pinGuards.size());
+    }
+
+    TEST_ASSERT_EQUAL_INT(buttons.size(), config.buttons.size());
+    for (int i = 0; i < buttons.size(); i++){
+        const button_t& button = config.buttons[i];
+        TEST_ASSERT_EQUAL_STRING(buttons[i].name.c_str(), button.name.c_str());
+        TEST_ASSERT_EQUAL_INT(i, button.id);
+        TEST_ASSERT_EQUAL_INT(buttons[i].groupId, button.groupId);
+        TEST_ASSERT_TRUE(buttons[i].pinIds == button.pinIds);
+        TEST_ASSERT_TRUE(sameTx(buttons[i].outputs, button.outputs));
+        TEST_ASSERT_EQUAL_INT(0, memcmp(&buttons[i].guardMask, &button.guardMask, sizeof(guardMask_t)));
+    }
+
+    TEST_ASSERT_EQUAL_INT(groups.size(), config.button_groups.size());
+    for (int i = 0; i < groups.size(); i++){
+        const buttonGroup_t& group = config.button_groups[i];
+        TEST_ASSERT_EQUAL_STRING(groups[i].name.c_str(), group.name.c_str());
+        TEST_ASSERT_TRUE(groups[i].buttonIds == group.buttonIds);
+        TEST_ASSERT_TRUE(sameTx(groups[i].reset, group.reset));
+    }
+
+    // lookups and compiled guards are rebuilt
+    TEST_ASSERT_EQUAL_HEX16(guardedInputs, config.guardedInputs);
+    TEST_ASSERT_EQUAL_INT(1, config.findGroup("b"));
+    TEST_ASSERT_EQUAL_INT(1, config.findButton(0, "second"));
+    TEST_ASSERT_EQUAL_INT(2, config.getPinId("SINK3"));
+}
+
+void test_rejects_other_source(){
+    TEST_ASSERT_NOT_NULL(configImage::validate(image.data(), image.size(), SOURCE_HASH + 1));
+}
+
+void test_rejects_other_version(){
+    ((cfgImageHeader_t*)image.data())->version++;
+    TEST_ASSERT_NOT_NULL(configImage::validate(image.data(), image.size(), SOURCE_HASH));
+}
+
+void test_rejects_corrupted(){
+    image[image.size() / 2] ^= 0x01;
+    TEST_ASSERT_NOT_NULL(configImage::validate(image.data(), image.size(), SOURCE_HASH));
+}
+
+void test_rejects_truncated(){
+    TEST_ASSERT_NOT_NULL(configImage::validate(image.data(), image.size() - 1, SOURCE_HASH));
+    TEST_ASSERT_NOT_NULL(configImage::validate(image.data(), sizeof(cfgImageHeader_t) - 1, SOURCE_HASH));
+}
+
+void test_rejects_out_of_range_ids(){
+    // a valid hash over invalid contents
+    cfgImageHeader_t* h = (cfgImageHeader_t*)image.data();
+    cfgImageButton_t* buttons = (cfgImageButton_t*)(image.data() + h->buttons);
+    buttons[0].groupId = h->groupCount;
+    h->bodyHash = configHash(CONFIG_HASH_SEED,
+        image.data() + sizeof(cfgImageHeader_t), h->size - sizeof(cfgImageHeader_t));
+    TEST_ASSERT_NOT_NULL(configImage::validate(image.data(), image.size(), SOURCE_HASH));
+}
+
+void test_partition_store_load(){
+    TEST_ASSERT_TRUE(ConfigImageStore::store(image));
+
+    config.clearPresets();
+    TEST_ASSERT_FALSE(ConfigImageStore::load(SOURCE_HASH + 1, config));
+    TEST_ASSERT_TRUE(ConfigImageStore::load(SOURCE_HASH, config));
+    TEST_ASSERT_EQUAL_INT(3, config.buttons.size());
+
+    // a smaller image over a larger one
+    std::istringstream istr("[[pin]]\nname = \"X\"\nantctrl = \"RL1\"\nsch = \"X\"\n");
+    config.clearPresets();
+    TEST_ASSERT_TRUE(config.parseToml(istr, "small"));
+    std::vector<uint8_t> smallImage;
+    configImage::build(config, SOURCE_HASH, smallImage);
+    TEST_ASSERT_TRUE(ConfigImageStore::store(smallImage));
+    config.clearPresets();
+    TEST_ASSERT_TRUE(ConfigImageStore::load(SOURCE_HASH, config));
+    TEST_ASSERT_EQUAL_INT(1, config.pins.size());
+}
+
+void test_no_partition(){
+    const char* label = mock_partition_label;
+    mock_partition_label = NULL;
+    TEST_ASSERT_FALSE(ConfigImageStore::store(image));
+    TEST_ASSERT_FALSE(ConfigImageStore::load(SOURCE_HASH, config));
+    mock_partition_label = label;
+}
+
+int main(int argc, char **argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_roundtrip);
+    RUN_TEST(test_rejects_other_source);
+    RUN_TEST(test_rejects_other_version);
+    RUN_TEST(test_rejects_corrupted);
+    RUN_TEST(test_rejects_truncated);
+    RUN_TEST(test_rejects_out_of_range_ids);
+    RUN_TEST(test_partition_store_load);
+    RUN_TEST(test_no_partition);
+    return UNITY_END();
+}
@@ -0,0 +1,211 @@
+// Config hot-reload (ConfigStore_ in src/configHandler.h) - a published
+// config is swapped in on the controller task, active buttons are
+// carried over by name, and only outputs that differ are written.
+// Run with `pio test -e native`.
+
+#include <unity.h>
+
+#include <sstream>
+#include <string>
+
+#include "ioController.h"
+#include "configHandler.h"
+#include "apiCommand.h"
+#include "jsonPool.h"
+
+const char PINS[] = R"(
+[[pin]]
+name = "ANT1"
+antctrl = "RL1"
+sch = "RL1"
+
+[[pin]]
+name = "ANT2"
+antctrl = "RL2"
+sch = "RL2"
+
+[[pin]]
+name = "LNA"
+antctrl = "RL3"
+sch = "RL3"
+
+[[pin]]
+name = "AMP"
+antctrl = "SINK1"
+sch = "SINK1"
+
+[[pin]]
+name = "PTT"
+antctrl = "INP4"
+sch = "IN4"
+)";
+
+const char CONFIG_A[] = R"(
+[[buttons.ant]]
+name = "a1"
+pins = ["ANT1"]
+
+[[buttons.ant]]
+name = "a2"
+pins = ["ANT2"]
+
+[[buttons.amp]]
+name = "on"
+pins = ["AMP"]
+
+[[buttons.lna]]
+name = "on"
+pins = ["LNA"]
+)";
+
+// buttons reordered, a group added in front and "lna" removed -
+// every id changes, the names don't
+const char CONFIG_B[] = R"(
+[[buttons.aaa]]
+name = "x"
+pins = ["LNA"]
+
+[[buttons.amp]]
+name = "on"
+pins = ["AMP"]
+
+[[buttons.ant]]
+name = "a2"
+pins = ["ANT2"]
+
+[[buttons.ant]]
+name = "a1"
+pins = ["ANT1"]
+)";
+
+// "a1" may no longer be on while PTT is low
+const char CONFIG_GUARDED[] = R"(
+[[buttons.ant]]
+name = "a1"
+pins = ["ANT1"]
+disable_on_low = ["PTT"]
+
+[[buttons.amp]]
+name = "on"
+pins = ["AMP"]
+)";
+
+static TwoWire wire(0);
+static IoController ioController;
+
+static void publish(const char* buttons){
+    std::istringstream istr(std::string(PINS) + buttons);
+    std::shared_ptr<Config_> next = std::make_shared<Config_>();
+    TEST_ASSERT_TRUE(next->parseToml(istr, "test"));
+    ConfigStore.publish(next);
+}
+
+static void pressButton(const char* path){
+    apiCommand_t cmd;
+    TEST_ASSERT_TRUE(parseApiCommand(path, cmd));
+    PooledJson json;
+    ioController.handleApiCall(cmd, *json);
+    TEST_ASSERT_EQUAL_STRING("OK", (*json)["msg"].as<const char*>());
+}
+
+static int activeButton(const char* group){
+    const Config_& cfg = ConfigStore.active();
+    binStateFrame_t frame;
+    ioController.getStateFrame(frame);
+    return frame.activeButtons[cfg.findGroup(group)];
+}
+
+static int buttonId(const char* group, const char* name){
+    const Config_& cfg = ConfigStore.active();
+    return cfg.findButton(cfg.findGroup(group), name);
+}
+
+void setUp(){
+    publish(CONFIG_A);
+    pressButton("BUT/ant/a1");
+    pressButton("BUT/amp/on");
+    pressButton("BUT/lna/on");
+}
+
+void tearDown(){}
+
+void test_same_config_writes_nothing(){
+    uint32_t generation = ConfigStore.get()->generation;
+    uint32_t writes = mock_i2c_writes;
+
+    publish(CONFIG_A);
+
+    TEST_ASSERT_EQUAL_UINT32(generation + 1, ConfigStore.get()->generation);
+    TEST_ASSERT_EQUAL_UINT32(writes, mock_i2c_writes);
+    TEST_ASSERT_EQUAL_INT(buttonId("ant", "a1"), activeButton("ant"));
+    TEST_ASSERT_EQUAL_INT(buttonId("amp", "on"), activeButton("amp"));
+    TEST_ASSERT_EQUAL_INT(buttonId("lna", "on"), activeButton("lna"));
+}
+
+void test_buttons_remapped_by_name(){
+    publish(CONFIG_B);
+
+    TEST_ASSERT_EQUAL_INT(buttonId("ant", "a1"), activeButton("ant"));
+    TEST_ASSERT_EQUAL_INT(buttonId("amp", "on"), activeButton("amp"));
+    TEST_ASSERT_EQUAL_INT(BUTTON_NONE, activeButton("aaa"));
+    TEST_ASSERT_TRUE(ioController.getIoValue(RELAY, 0));
+    TEST_ASSERT_FALSE(ioController.getIoValue(RELAY, 1));
+    TEST_ASSERT_TRUE(ioController.getIoValue(MOSFET, 0));
+    // its button is gone
+    TEST_ASSERT_FALSE(ioController.getIoValue(RELAY, 2));
+}
+
+void test_prevented_button_turned_off(){
+    ioController.notifyOnBitsChange(0x0000);
+    publish(CONFIG_GUARDED);
+
+    TEST_ASSERT_EQUAL_INT(BUTTON_NONE, activeButton("ant"));
+    TEST_ASSERT_EQUAL_INT(buttonId("amp", "on"), activeButton("amp"));
+    TEST_ASSERT_FALSE(ioController.getIoValue(RELAY, 0));
+    TEST_ASSERT_TRUE(ioController.getIoValue(MOSFET, 0));
+}
+
+void test_snapshot_outlives_publish(){
+    configSnapshot_t held = ConfigStore.get();
+    publish(CONFIG_B);
+
+    TEST_ASSERT_TRUE(held != ConfigStore.get());
+    TEST_ASSERT_EQUAL_INT(1, held.use_count());
+    TEST_ASSERT_EQUAL_INT(2, held->findGroup("lna"));
+    TEST_ASSERT_EQUAL_STRING("on", held->buttons[held->findButton(2, "on")].name.c_str());
+}
+
+// "RL0" - schematic numbers start at 1
+void test_negative_pin_number_rejected(){
+    std::istringstream istr(R"(
+[[pin]]
+name = "ANT0"
+antctrl = "RL0"
+sch = "RL0"
+)");
+    Config_ config;
+    TEST_ASSERT_FALSE(config.parseToml(istr, "test"));
+}
+
+// /api/INF would be truncated
+void test_long_state_rejected(){
+    std::string buttons = "[[buttons.ant]]\nname = \"" +
+        std::string(API_JSON_CAPACITY, 'x') + "\"\npins = [\"ANT1\"]\n";
+    std::istringstream istr(std::string(PINS) + buttons);
+    Config_ config;
+    TEST_ASSERT_FALSE(config.parseToml(istr, "test"));
+}
+
+int main(int argc, char **argv){
+    JsonPool.begin();
+    ioController.begin(wire);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_same_config_writes_nothing);
+    RUN_TEST(test_buttons_remapped_by_name);
+    RUN_TEST(test_prevented_button_turned_off);
+    RUN_TEST(test_snapshot_outlives_publish);
+    RUN_TEST(test_negative_pin_number_rejected);
+    RUN_TEST(test_long_state_rejected);
+    return UNITY_END();
+}
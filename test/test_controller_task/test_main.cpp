@@ -0,0 +1,114 @@
+// Call slots of the controller task (src/controllerTask.h) - a slot
+// must not be handed out again while its reply may still be read.
+// Run with `pio test -e native`.
+
+#include <unity.h>
+
+#include <cstring>
+
+#include "controllerTask.h"
+
+const char REPLY[] = "reply";
+
+// completes the call, but reports a failure - like a job whose
+// request was invalid
+static bool failingCallJob(void* arg){
+    ctrlCall_t* call = (ctrlCall_t*)arg;
+    call->code = 400;
+    call->len = sizeof(REPLY);
+    memcpy(call->buf, REPLY, sizeof(REPLY));
+    ControllerTask.completeCall(call);
+    return false;
+}
+
+// calls never posted to a job - completed here, so they are freed
+static void releaseAll(ctrlCall_t** calls, int count){
+    for (int i = 0; i < count; i++){
+        ControllerTask.completeCall(calls[i]);
+        ControllerTask.releaseCall(calls[i]);
+    }
+}
+
+void setUp(){}
+
+void tearDown(){}
+
+// the task isn't started, so the job runs inline
+void test_failed_job_completes_call_once(){
+    ctrlCall_t* call = ControllerTask.acquireCall();
+    TEST_ASSERT_NOT_NULL(call);
+
+    TEST_ASSERT_TRUE(ControllerTask.postCall(CTRL_LANE_API, failingCallJob, call));
+    TEST_ASSERT_TRUE(ControllerTask.isCallDone(call));
+    TEST_ASSERT_EQUAL_INT(400, call->code);
+
+    // the slot is still held, the reply is not overwritten
+    ctrlCall_t* others[CTRL_CALL_COUNT - 1];
+    for (auto& other: others){
+        other = ControllerTask.acquireCall();
+        TEST_ASSERT_NOT_NULL(other);
+    }
+    TEST_ASSERT_NULL(ControllerTask.acquireCall());
+    TEST_ASSERT_EQUAL_STRING(REPLY, call->buf);
+
+    releaseAll(others, CTRL_CALL_COUNT - 1);
+    ControllerTask.releaseCall(call);
+}
+
+void test_run_call_failing_job(){
+    ctrlCall_t* call = ControllerTask.acquireCall();
+    TEST_ASSERT_TRUE(ControllerTask.runCall(CTRL_LANE_API, failingCallJob, call));
+    TEST_ASSERT_TRUE(ControllerTask.isCallDone(call));
+    TEST_ASSERT_EQUAL_INT(400, call->code);
+    ControllerTask.releaseCall(call);
+}
+
+void test_second_complete_is_ignored(){
+    ctrlCall_t* call = ControllerTask.acquireCall();
+    ControllerTask.completeCall(call);
+    ControllerTask.completeCall(call);
+    TEST_ASSERT_TRUE(ControllerTask.isCallDone(call));
+    ControllerTask.releaseCall(call);
+}
+
+void test_released_calls_are_reused(){
+    ctrlCall_t* calls[CTRL_CALL_COUNT];
+    for (auto& call: calls){
+        call = ControllerTask.acquireCall();
+        TEST_ASSERT_NOT_NULL(call);
+    }
+    // abandoned before completion - freed by completeCall()
+    ControllerTask.releaseCall(calls[0]);
+    TEST_ASSERT_NULL(ControllerTask.acquireCall());
+    ControllerTask.completeCall(calls[0]);
+    TEST_ASSERT_EQUAL_PTR(calls[0], ControllerTask.acquireCall());
+
+    releaseAll(calls, CTRL_CALL_COUNT);
+}
+
+// the HTTP handler's wait ends as soon as the call completes
+void test_wait_call(){
+    ctrlCall_t* call = ControllerTask.acquireCall();
+    TEST_ASSERT_FALSE(ControllerTask.waitCall(call, CTRL_CALL_WAIT_MS));
+    ControllerTask.completeCall(call);
+    TEST_ASSERT_TRUE(ControllerTask.waitCall(call, CTRL_CALL_WAIT_MS));
+    ControllerTask.releaseCall(call);
+
+    // not left given for the next owner of the slot
+    call = ControllerTask.acquireCall();
+    TEST_ASSERT_FALSE(ControllerTask.waitCall(call, 0));
+    ControllerTask.completeCall(call);
+    ControllerTask.releaseCall(call);
+}
+
+int main(int argc, char **argv){
+    ControllerTask.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_failed_job_completes_call_once);
+    RUN_TEST(test_run_call_failing_job);
+    RUN_TEST(test_second_complete_is_ignored);
+    RUN_TEST(test_released_calls_are_reused);
+    RUN_TEST(test_wait_call);
+    return UNITY_END();
+}
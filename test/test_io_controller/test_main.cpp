@@ -0,0 +1,170 @@
+// Output paths of IoController (button, batch and binary writes) against
+// the mock PCA9555, on the built-in config. Run with `pio test -e native`.
+
+#include <unity.h>
+
+#include <cstring>
+
+#include "ioController.h"
+#include "configHandler.h"
+#include "apiCommand.h"
+#include "binaryFrame.h"
+#include "jsonPool.h"
+
+static TwoWire wire(0);
+static IoController ioController;
+
+static void call(const char* path, JsonDocument& json){
+    apiCommand_t cmd;
+    parseApiCommand(path, cmd);
+    ioController.handleApiCall(cmd, json);
+}
+
+static void batch(const char* body, JsonDocument& json){
+    static apiCommand_t cmds[BATCH_MAX_COMMANDS];
+    int count = parseApiBatch(body, cmds, BATCH_MAX_COMMANDS);
+    ioController.handleBatch(cmds, count, json);
+}
+
+static binStatus_t writeFrame(const binWriteOp_t* ops, int count){
+    uint8_t frame[sizeof(binWriteHeader_t) + BIN_MAX_WRITE_OPS * sizeof(binWriteOp_t)];
+    binWriteHeader_t header = {BIN_MAGIC_WRITE, BIN_PROTO_VERSION, (uint8_t)count};
+    memcpy(frame, &header, sizeof(header));
+    memcpy(frame + sizeof(header), ops, count * sizeof(binWriteOp_t));
+    binStateFrame_t reply;
+    return ioController.handleBinaryFrame(frame,
+        sizeof(header) + count * sizeof(binWriteOp_t), reply);
+}
+
+void setUp(){
+    mock_i2c_fail = false;
+    PooledJson json;
+    batch("BUT/a/OFF;BUT/b/OFF;MOS/bits/0;REL/bits/0;OPT/bits/0;TTL/bits/0", *json);
+}
+
+void tearDown(){
+    mock_i2c_fail = false;
+}
+
+void test_button_write_failure(){
+    mock_i2c_fail = true;
+    PooledJson json;
+    call("BUT/a/A1", *json);
+    TEST_ASSERT_EQUAL_STRING("ERR", (*json)["msg"].as<const char*>());
+
+    // the "make" write failed - the button must not be reported as on
+    mock_i2c_fail = false;
+    PooledJson state;
+    call("INF", *state);
+    TEST_ASSERT_EQUAL_STRING("OFF", (*state)["buttons"]["groups"]["a"].as<const char*>());
+}
+
+void test_batch_write_failure(){
+    mock_i2c_fail = true;
+    PooledJson json;
+    batch("MOS/1/on;REL/1/on", *json);
+    TEST_ASSERT_EQUAL_INT(500, (*json)["retCode"].as<int>());
+    TEST_ASSERT_EQUAL_STRING("ERR: expander write failed", (*json)["msg"].as<const char*>());
+}
+
+void test_binary_write_failure(){
+    binWriteOp_t ops[] = {{MOSFET, BIN_OP_SET, 0x0001}, {RELAY, BIN_OP_SET, 0x0001}};
+    mock_i2c_fail = true;
+    TEST_ASSERT_EQUAL_INT(BIN_ERR_BUS, writeFrame(ops, 2));
+    mock_i2c_fail = false;
+    TEST_ASSERT_EQUAL_INT(BIN_OK, writeFrame(ops, 2));
+}
+
+// only the expanders whose register changes are written
+void test_unchanged_expanders_not_written(){
+    PooledJson json;
+    batch("MOS/1/on;REL/1/on", *json);
+    TEST_ASSERT_EQUAL_INT(200, (*json)["retCode"].as<int>());
+
+    uint32_t writes = mock_i2c_writes;
+    PooledJson json2;
+    batch("MOS/1/on;REL/2/on", *json2);
+    TEST_ASSERT_EQUAL_INT(200, (*json2)["retCode"].as<int>());
+    TEST_ASSERT_EQUAL_UINT32(writes + 1, mock_i2c_writes);
+}
+
+// Config_::stateJsonLength() is an upper bound of the real state
+void test_state_length_bound(){
+    PooledJson json;
+    batch("BUT/a/A1;BUT/b/B1;BUT/c/C1", *json);
+    TEST_ASSERT_EQUAL_INT(200, (*json)["retCode"].as<int>());
+
+    PooledJson state;
+    call("INF", *state);
+    TEST_ASSERT_FALSE((*state).overflowed());
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(ConfigStore.active().stateJsonLength(),
+        measureJson(*state));
+}
+
+// a delta that wasn't sent is built again, changes are only cleared
+// by commitStateDelta()
+void test_delta_kept_until_committed(){
+    bool isFull = true;
+    {
+        PooledJson json;
+        ioController.getStateDelta(*json, &isFull);
+        ioController.commitStateDelta();
+    }
+    PooledJson reply;
+    call("BUT/a/A1", *reply);
+
+    PooledJson delta;
+    isFull = false;
+    TEST_ASSERT_TRUE(ioController.getStateDelta(*delta, &isFull));
+    TEST_ASSERT_FALSE(isFull);
+
+    PooledJson again;
+    isFull = false;
+    TEST_ASSERT_TRUE(ioController.getStateDelta(*again, &isFull));
+    TEST_ASSERT_EQUAL_UINT32(measureJson(*delta), measureJson(*again));
+
+    ioController.commitStateDelta();
+    (*again).clear();
+    isFull = false;
+    TEST_ASSERT_FALSE(ioController.getStateDelta(*again, &isFull));
+}
+
+// a failed safe state write is counted, and retried by the resync
+void test_safe_state_write_failure(){
+    const uint16_t unlocked = 0x01 << INPUT_LOCK_BIT;
+    PooledJson json;
+    call("SAF/reset", *json);
+
+    mock_i2c_fail = true;
+    ioController.handleInputBits(unlocked | (0x01 << INPUT_PANIC_BIT), micros());
+    TEST_ASSERT_FALSE(ioController.resyncSafetyWrites());
+    mock_i2c_fail = false;
+
+    PooledJson stats;
+    call("SAF", *stats);
+    TEST_ASSERT_EQUAL_INT(1, (*stats)["writeFailures"].as<int>());
+    TEST_ASSERT_TRUE((*stats)["resyncPending"].as<bool>());
+
+    TEST_ASSERT_TRUE(ioController.resyncSafetyWrites());
+    PooledJson after;
+    call("SAF", *after);
+    TEST_ASSERT_FALSE((*after)["resyncPending"].as<bool>());
+
+    ioController.handleInputBits(unlocked, micros());
+}
+
+int main(int argc, char **argv){
+    JsonPool.begin();
+    ioController.begin(wire);
+    ConfigStore.loadBuiltin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_button_write_failure);
+    RUN_TEST(test_batch_write_failure);
+    RUN_TEST(test_binary_write_failure);
+    RUN_TEST(test_unchanged_expanders_not_written);
+    RUN_TEST(test_state_length_bound);
+    RUN_TEST(test_delta_kept_until_committed);
+    RUN_TEST(test_safe_state_write_failure);
+    return UNITY_END();
+}
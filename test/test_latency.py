@@ -0,0 +1,57 @@
+import http.client
+import sys
+import time
+import urllib.parse
+
+# Measures request-to-first-byte latency of API calls - calls that wait
+# for the I2C bus (buttons, output writes) included. Fails if any reply
+# starts later than LIMIT_MS. Requires buttons_simple.conf loaded.
+#
+# usage: python3 test_latency.py <ip> [<limit ms>]
+
+IP = "192.168.0.145"
+LIMIT_MS = 50
+ROUNDS = 20
+
+commands = [
+    "INF",
+    "BUT/a/A1",
+    "BUT/a/A2",
+    "REL/1/on",
+    "REL/1/off",
+    "BUT/a/OFF",
+]
+
+if len(sys.argv) > 1:
+    IP = sys.argv[1]
+if len(sys.argv) > 2:
+    LIMIT_MS = float(sys.argv[2])
+
+# time from sending the request to the status line of the reply
+def firstByteMs(command):
+    conn = http.client.HTTPConnection(IP, timeout=5)
+    conn.connect()
+    startTime = time.perf_counter()
+    conn.request("GET", "/api/" + urllib.parse.quote(command))
+    resp = conn.getresponse()
+    elapsedMs = (time.perf_counter() - startTime) * 1000
+    resp.read()
+    conn.close()
+    if resp.status != 200:
+        print("{}: status {}".format(command, resp.status))
+    return elapsedMs
+
+failed = 0
+
+for command in commands:
+    times = sorted(firstByteMs(command) for _ in range(ROUNDS))
+    worstMs = times[-1]
+    print("{:<12} min {:6.1f}ms  median {:6.1f}ms  max {:6.1f}ms".format(
+        command, times[0], times[len(times) // 2], worstMs))
+    if worstMs > LIMIT_MS:
+        failed += 1
+
+if failed > 0:
+    print("{} command(s) over {}ms".format(failed, LIMIT_MS))
+    sys.exit(1)
+print("All replies within {}ms".format(LIMIT_MS))
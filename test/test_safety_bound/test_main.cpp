@@ -0,0 +1,210 @@
+// Panic reaction bound, run with `pio test -e native`. The test acts as
+// the bus and controller tasks (see freertosShim.h) - jobs go through
+// the real I2cBus and ControllerTask lanes, and the latency is the one
+// IoController records for /api/SAF. The bus is timed with the cost
+// model from safetyBound.h.
+
+#include <unity.h>
+
+#include "safetyBound.h"
+#include "latencyHistogram.h"
+#include "ioController.h"
+#include "configHandler.h"
+#include "apiCommand.h"
+#include "jsonPool.h"
+
+const uint32_t BOUND_US = safety::reactionBoundUs(EXP_COUNT);
+// the bound, if the panic job didn't wait for the controller job in
+// progress
+const uint32_t NO_HOL_BOUND_US = safety::TASK_WAKE_US +
+    safety::DISPLAY_TRANSFER_MAX_US + EXP_COUNT * safety::EXPANDER_WRITE_US;
+
+const uint16_t UNLOCKED_BITS = 0x01 << INPUT_LOCK_BIT;
+const uint16_t PANIC_BITS = UNLOCKED_BITS | (0x01 << INPUT_PANIC_BIT);
+// the test itself - the watchdog and async_tcp tasks
+const TaskHandle_t CALLER_TASK = (TaskHandle_t)0x01;
+
+static TwoWire wire(0);
+static IoController ioController;
+static TaskHandle_t busTask;
+static TaskHandle_t controllerTask;
+
+// Worst case for the bus jobs - the display always has a page pending,
+// so it gets the bus whenever the bus task is idle. Its transactions
+// run back to back from displayFromUs.
+static int64_t displayFromUs;
+// called once, when the controller first waits for the bus
+static void (*onBusWait)() = NULL;
+
+static bool runTask(TaskHandle_t task, LaneWorker& worker){
+    TaskHandle_t current = mock_current_task;
+    mock_current_task = task;
+    bool anyJob = worker.runPending();
+    mock_current_task = current;
+    return anyJob;
+}
+
+// someone waits for a bus job - run the bus task. False if it had
+// nothing to do, the wait would never end.
+static bool busWaitHook(){
+    if (onBusWait != NULL){
+        void (*fn)() = onBusWait;
+        onBusWait = NULL;
+        fn();
+    }
+    // the display transaction in flight is finished first
+    while (displayFromUs <= (int64_t)mock_clock_us){
+        displayFromUs += safety::DISPLAY_TRANSFER_MAX_US;
+    }
+    mock_clock_us = displayFromUs;
+    bool anyJob = runTask(busTask, I2cBus);
+    displayFromUs = mock_clock_us;
+    return anyJob;
+}
+
+static void postInputBits(uint16_t bits, uint32_t edgeUs){
+    TaskHandle_t current = mock_current_task;
+    mock_current_task = CALLER_TASK;
+    ioController.postInputBits(bits, edgeUs);
+    mock_current_task = current;
+}
+
+// the edge came TASK_WAKE_US before the watchdog task posted it
+static void postPanicEdge(){
+    postInputBits(PANIC_BITS, mock_clock_us - safety::TASK_WAKE_US);
+}
+
+static bool buttonJob(void* p_path){
+    PooledJson json;
+    apiCommand_t cmd;
+    parseApiCommand((const char*)p_path, cmd);
+    ioController.handleApiCall(cmd, *json);
+    return true;
+}
+
+static void callButton(const char* path){
+    ControllerTask.post(CTRL_LANE_API, buttonJob, (void*)path);
+    runTask(controllerTask, ControllerTask);
+}
+
+static void getSafetyStats(JsonDocument& json, const char* path){
+    apiCommand_t cmd;
+    parseApiCommand(path, cmd);
+    ioController.handleApiCall(cmd, json);
+}
+
+void setUp(){}
+
+void tearDown(){}
+
+void test_cost_model(){
+    // 38 clocks at 100kHz
+    TEST_ASSERT_EQUAL_UINT32(380, safety::EXPANDER_WRITE_US);
+    // 20 + 29 clocks
+    TEST_ASSERT_EQUAL_UINT32(490, safety::EXPANDER_READ_US);
+    // 1163 clocks
+    TEST_ASSERT_EQUAL_UINT32(11630, safety::DISPLAY_TRANSFER_MAX_US);
+    // a button switch - 2 phases of 3 writes and the dead-time
+    TEST_ASSERT_EQUAL_UINT32(3280, safety::busJobMaxUs(3));
+    TEST_ASSERT_EQUAL_UINT32(30180, safety::reactionBoundUs(3));
+}
+
+// A button switch is in progress on the controller task, its bus job
+// just queued, when the panic edge comes in. The panic job waits for
+// it - so the bound has to include the controller job.
+void test_panic_behind_button_switch(){
+    PooledJson json;
+    getSafetyStats(*json, "SAF/reset");
+
+    uint32_t reactions = 0;
+    for (uint32_t phase = 0; phase < safety::DISPLAY_TRANSFER_MAX_US; phase += 97){
+        postInputBits(UNLOCKED_BITS, mock_clock_us);
+        runTask(controllerTask, ControllerTask);
+        TEST_ASSERT_FALSE(ioController.inPanic);
+        callButton("BUT/a/A1");
+
+        displayFromUs = (int64_t)mock_clock_us - phase;
+        onBusWait = postPanicEdge;
+        callButton("BUT/a/A2");
+        TEST_ASSERT_TRUE(ioController.inPanic);
+        reactions++;
+    }
+
+    PooledJson stats;
+    getSafetyStats(*stats, "SAF");
+    JsonObject panic = (*stats)["panic"];
+    TEST_ASSERT_EQUAL_UINT32(reactions, panic["count"].as<uint32_t>());
+    TEST_ASSERT_EQUAL_UINT32(0, panic["overBound"].as<uint32_t>());
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(BOUND_US, panic["maxUs"].as<uint32_t>());
+    TEST_ASSERT_GREATER_THAN_UINT32(NO_HOL_BOUND_US, panic["maxUs"].as<uint32_t>());
+}
+
+void test_histogram_buckets(){
+    TEST_ASSERT_EQUAL_INT(0, LatencyHistogram::bucketOf(0));
+    TEST_ASSERT_EQUAL_INT(0, LatencyHistogram::bucketOf(63));
+    TEST_ASSERT_EQUAL_INT(1, LatencyHistogram::bucketOf(64));
+    TEST_ASSERT_EQUAL_INT(1, LatencyHistogram::bucketOf(127));
+    TEST_ASSERT_EQUAL_INT(2, LatencyHistogram::bucketOf(128));
+    TEST_ASSERT_EQUAL_INT(LATENCY_BUCKETS - 1, LatencyHistogram::bucketOf(UINT32_MAX));
+
+    for (int b = 0; b < LATENCY_BUCKETS - 1; b++){
+        uint32_t limit = LatencyHistogram::bucketLimit(b);
+        TEST_ASSERT_EQUAL_INT(b, LatencyHistogram::bucketOf(limit - 1));
+        TEST_ASSERT_EQUAL_INT(b + 1, LatencyHistogram::bucketOf(limit));
+    }
+}
+
+void test_cycle_histogram_buckets(){
+    // span histograms, see traceSpan.h
+    typedef Log2Histogram<32, 0> CycleHistogram;
+    TEST_ASSERT_EQUAL_INT(0, CycleHistogram::bucketOf(0));
+    TEST_ASSERT_EQUAL_INT(1, CycleHistogram::bucketOf(1));
+    TEST_ASSERT_EQUAL_INT(2, CycleHistogram::bucketOf(2));
+    TEST_ASSERT_EQUAL_INT(2, CycleHistogram::bucketOf(3));
+    TEST_ASSERT_EQUAL_INT(31, CycleHistogram::bucketOf(0x40000000));
+    TEST_ASSERT_EQUAL_INT(31, CycleHistogram::bucketOf(UINT32_MAX));
+    TEST_ASSERT_EQUAL_UINT32(0x40000000, CycleHistogram::bucketLimit(30));
+}
+
+void test_histogram_stats(){
+    LatencyHistogram histogram(1000);
+    histogram.record(10);
+    histogram.record(500);
+    histogram.record(5000);
+
+    TEST_ASSERT_EQUAL_UINT32(3, histogram.getCount());
+    TEST_ASSERT_EQUAL_UINT32(5000, histogram.getMax());
+    TEST_ASSERT_EQUAL_UINT32(1, histogram.getOverBound());
+    TEST_ASSERT_EQUAL_UINT32(1, histogram.getBucket(LatencyHistogram::bucketOf(500)));
+
+    histogram.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.getCount());
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.getOverBound());
+}
+
+int main(int argc, char **argv){
+    JsonPool.begin();
+    ioController.begin(wire);
+    ConfigStore.loadBuiltin();
+
+    // from now on, the test runs the bus and controller tasks
+    mock_tasks_enabled = true;
+    I2cBus.begin();
+    ControllerTask.begin();
+    busTask = mock_task_handle(static_cast<LaneWorker*>(&I2cBus));
+    controllerTask = mock_task_handle(static_cast<LaneWorker*>(&ControllerTask));
+    mock_block_hook = busWaitHook;
+
+    mock_clock_manual = true;
+    mock_clock_us = 1000000;
+    mock_i2c_write_us = safety::EXPANDER_WRITE_US;
+    mock_i2c_read_us = safety::EXPANDER_READ_US;
+
+    UNITY_BEGIN();
+    RUN_TEST(test_cost_model);
+    RUN_TEST(test_panic_behind_button_switch);
+    RUN_TEST(test_histogram_buckets);
+    RUN_TEST(test_cycle_histogram_buckets);
+    RUN_TEST(test_histogram_stats);
+    return UNITY_END();
+}
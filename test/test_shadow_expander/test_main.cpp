@@ -0,0 +1,74 @@
+// Shadow registers (src/shadowExpander.h) against the mock PCA9555 -
+// bus failures have to be reported, never hidden behind the shadow.
+// Run with `pio test -e native`.
+
+#include <unity.h>
+
+#include "shadowExpander.h"
+
+static TwoWire wire(0);
+
+void setUp(){
+    mock_i2c_fail = false;
+}
+
+void tearDown(){
+    mock_i2c_fail = false;
+}
+
+void test_attach_fails_without_expander(){
+    ShadowExpander e;
+    mock_i2c_fail = true;
+    TEST_ASSERT_EQUAL_INT(RET_ERR, e.attach(wire, 0x20));
+    mock_i2c_fail = false;
+    TEST_ASSERT_EQUAL_INT(RET_OK, e.attach(wire, 0x20));
+}
+
+void test_verify_matches(){
+    ShadowExpander e;
+    e.attach(wire, 0x20);
+    TEST_ASSERT_TRUE(e.write(0x1234));
+
+    uint16_t hwBits = 0;
+    TEST_ASSERT_TRUE(e.verify(&hwBits));
+    TEST_ASSERT_EQUAL_HEX16(0x1234, hwBits);
+    TEST_ASSERT_FALSE(e.isDiverged());
+}
+
+void test_failed_read_is_not_verified(){
+    ShadowExpander e;
+    e.attach(wire, 0x20);
+    TEST_ASSERT_TRUE(e.write(0xFFFF));
+
+    // a NACKed read returns 0xFFFF, same as the shadow
+    mock_i2c_fail = true;
+    uint16_t hwBits = 0x5555;
+    TEST_ASSERT_FALSE(e.verify(&hwBits));
+    TEST_ASSERT_EQUAL_HEX16(0x5555, hwBits);
+    TEST_ASSERT_TRUE(e.isDiverged());
+    TEST_ASSERT_EQUAL_UINT32(1, e.getReadErrors());
+}
+
+void test_failed_write_keeps_shadow(){
+    ShadowExpander e;
+    e.attach(wire, 0x20);
+
+    mock_i2c_fail = true;
+    TEST_ASSERT_FALSE(e.write(0x00F0));
+    TEST_ASSERT_EQUAL_HEX16(0x00F0, e.read());
+    TEST_ASSERT_TRUE(e.isDiverged());
+    TEST_ASSERT_EQUAL_UINT32(1, e.getWriteErrors());
+
+    mock_i2c_fail = false;
+    TEST_ASSERT_TRUE(e.resync());
+    TEST_ASSERT_FALSE(e.isDiverged());
+}
+
+int main(int argc, char **argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_attach_fails_without_expander);
+    RUN_TEST(test_verify_matches);
+    RUN_TEST(test_failed_read_is_not_verified);
+    RUN_TEST(test_failed_write_keeps_shadow);
+    return UNITY_END();
+}
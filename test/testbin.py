@@ -0,0 +1,91 @@
+import struct
+import sys
+import time
+import urllib.request
+
+# Reads the binary state frame, and optionally applies masked writes.
+# Layout is described in src/binaryFrame.h.
+#
+# usage: python3 testbin.py <ip> [<TAG> <set|clear|toggle> <mask> ...]
+# e.g.   python3 testbin.py 192.168.0.145 MOS set 0x0003 REL toggle 0x0001
+#
+# With --poll, the frame is sent POLL_COUNT times at 20Hz instead, and
+# the check fails if any round-trip takes longer than ROUND_TRIP_MS.
+# e.g.   python3 testbin.py 192.168.0.145 --poll REL toggle 0x0001
+
+IP = "192.168.0.145"
+POLL_PERIOD_S = 0.05
+POLL_COUNT = 100
+ROUND_TRIP_MS = 50
+
+TAGS = ["MOS", "REL", "OPT", "TTL"]
+OPS = ["set", "clear", "toggle"]
+STATUS = ["OK", "ERR_FRAME", "ERR_VERSION", "ERR_ARG", "ERR_LOCKED", "ERR_BUS"]
+
+MAX_BUTTON_GROUPS = 32
+STATE_FORMAT = "<BBBBII4HHBB{}h".format(MAX_BUTTON_GROUPS)
+
+def decodeState(frame):
+    fields = struct.unpack(STATE_FORMAT, frame)
+    magic, version, status, flags, seq, generation = fields[0:6]
+    outputs = fields[6:10]
+    inputs, groupCount = fields[10], fields[11]
+    active = fields[13:13 + groupCount]
+
+    print("status: {} seq: {} generation: {} locked: {} panic: {}".format(
+        STATUS[status], seq, generation, bool(flags & 1), bool(flags & 2)))
+    for tag, bits in zip(TAGS, outputs):
+        print("  {}: {:#06x}".format(tag, bits))
+    print("  INP: {:#06x}".format(inputs))
+    print("  active buttons: {}".format(list(active)))
+
+def encodeWrite(args):
+    ops = b""
+    for i in range(0, len(args), 3):
+        tag, op, mask = args[i:i + 3]
+        ops += struct.pack("<BBH", TAGS.index(tag), OPS.index(op), int(mask, 0))
+    return struct.pack("<BBB", ord("W"), 1, len(ops) // 4) + ops
+
+def buildRequest(url, args):
+    if len(args) > 0:
+        # anything but form/text content type, or the server parses the body as params
+        return urllib.request.Request(url, data=encodeWrite(args), method="POST",
+            headers={"Content-Type": "application/octet-stream"})
+    return urllib.request.Request(url)
+
+# round-trips at 20Hz, returns the worst one in ms
+def poll(url, args):
+    times = []
+    for _ in range(POLL_COUNT):
+        startTime = time.perf_counter()
+        with urllib.request.urlopen(buildRequest(url, args)) as resp:
+            resp.read()
+        elapsed = time.perf_counter() - startTime
+        times.append(elapsed * 1000)
+        time.sleep(max(0, POLL_PERIOD_S - elapsed))
+    times.sort()
+    print("round-trip min {:.1f}ms median {:.1f}ms max {:.1f}ms".format(
+        times[0], times[len(times) // 2], times[-1]))
+    return times[-1]
+
+args = sys.argv[1:]
+if len(args) > 0:
+    IP = args.pop(0)
+pollMode = (len(args) > 0) and (args[0] == "--poll")
+if pollMode:
+    args.pop(0)
+
+url = "http://" + IP + "/api/BIN"
+
+if pollMode:
+    if poll(url, args) > ROUND_TRIP_MS:
+        print("round-trip over {}ms".format(ROUND_TRIP_MS))
+        sys.exit(1)
+    sys.exit(0)
+
+try:
+    with urllib.request.urlopen(buildRequest(url, args)) as resp:
+        decodeState(resp.read())
+except urllib.error.HTTPError as e:
+    decodeState(e.read())
+    sys.exit(1)
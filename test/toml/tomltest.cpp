@@ -22,8 +22,9 @@ int main(int argc, char* argv[]){
 
     std::istringstream is(buffer.str());
 
-    Config.parseToml(is, argv[1]);
-    Config.printConfig();
+    Config_ config;
+    config.parseToml(is, argv[1]);
+    config.printConfig();
     return 0;
 }
 